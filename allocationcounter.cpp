@@ -0,0 +1,186 @@
+/* Replaces the global operator new and delete with versions that count
+ * allocations, so tests can check that hot paths don't allocate.
+ */
+#include "allocationcounter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/* Each block starts with a header holding its size, so that delete knows
+ * how many bytes it gives back. The header is as big as malloc's alignment,
+ * so the caller's part of the block stays just as aligned.
+ */
+static const size_t kHeaderSize = alignof(max_align_t);
+
+static atomic<long> gNumAllocations(0);
+static atomic<long long> gNumBytesInUse(0);
+
+long numHeapAllocations() {
+    return gNumAllocations.load(memory_order_relaxed);
+}
+
+long long numHeapBytesInUse() {
+    return gNumBytesInUse.load(memory_order_relaxed);
+}
+
+/* Allocates a block with its size in a header in front, or returns nullptr. */
+static void* countedAlloc(size_t bytes) {
+    gNumAllocations.fetch_add(1, memory_order_relaxed);
+    char* block = (char*) malloc(kHeaderSize + bytes);
+    if (block == nullptr) return nullptr;
+    *(size_t*) block = bytes;
+    gNumBytesInUse.fetch_add(bytes, memory_order_relaxed);
+    return block + kHeaderSize;
+}
+
+static void countedFree(void* block) {
+    if (block == nullptr) return;
+    char* start = (char*) block - kHeaderSize;
+    gNumBytesInUse.fetch_sub(*(size_t*) start, memory_order_relaxed);
+    free(start);
+}
+
+/*
+ * Over-aligned blocks, such as the ones std::pmr::new_delete_resource asks
+ * for, get a header padded out to their alignment, with the size stored
+ * just before the caller's part.
+ */
+static void* countedAlignedAlloc(size_t bytes, align_val_t alignment) {
+    gNumAllocations.fetch_add(1, memory_order_relaxed);
+    size_t header = max(kHeaderSize, (size_t) alignment);
+    size_t total = (header + bytes + (size_t) alignment - 1) / (size_t) alignment * (size_t) alignment;
+    char* block = (char*) aligned_alloc((size_t) alignment, total);
+    if (block == nullptr) return nullptr;
+    *(size_t*) (block + header - sizeof(size_t)) = bytes;
+    gNumBytesInUse.fetch_add(bytes, memory_order_relaxed);
+    return block + header;
+}
+
+static void countedAlignedFree(void* block, align_val_t alignment) {
+    if (block == nullptr) return;
+    size_t header = max(kHeaderSize, (size_t) alignment);
+    gNumBytesInUse.fetch_sub(*(size_t*) ((char*) block - sizeof(size_t)), memory_order_relaxed);
+    free((char*) block - header);
+}
+
+/*
+ * Every form of new and delete is replaced, not just the throwing ones, so
+ * that every block delete sees has a header. Tools such as AddressSanitizer
+ * supply their own versions of any form left out, and std::stable_sort
+ * gets its buffer from the nothrow form.
+ */
+void* operator new(size_t bytes) {
+    void* block = countedAlloc(bytes);
+    if (block == nullptr) throw bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const nothrow_t&) noexcept {
+    return countedAlloc(bytes);
+}
+
+void* operator new[](size_t bytes, const nothrow_t&) noexcept {
+    return countedAlloc(bytes);
+}
+
+void operator delete(void* block) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block) noexcept {
+    countedFree(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    countedFree(block);
+}
+
+void operator delete(void* block, const nothrow_t&) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block, const nothrow_t&) noexcept {
+    countedFree(block);
+}
+
+void* operator new(size_t bytes, align_val_t alignment) {
+    void* block = countedAlignedAlloc(bytes, alignment);
+    if (block == nullptr) throw bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t bytes, align_val_t alignment) {
+    return operator new(bytes, alignment);
+}
+
+void* operator new(size_t bytes, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAlignedAlloc(bytes, alignment);
+}
+
+void* operator new[](size_t bytes, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAlignedAlloc(bytes, alignment);
+}
+
+void operator delete(void* block, align_val_t alignment) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+void operator delete[](void* block, align_val_t alignment) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+void operator delete(void* block, size_t, align_val_t alignment) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+void operator delete[](void* block, size_t, align_val_t alignment) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+void operator delete(void* block, align_val_t alignment, const nothrow_t&) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+void operator delete[](void* block, align_val_t alignment, const nothrow_t&) noexcept {
+    countedAlignedFree(block, alignment);
+}
+
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("Blocks from every form of new are counted and given back") {
+    long before = numHeapAllocations();
+    long long bytesBefore = numHeapBytesInUse();
+
+    // called directly, since the compiler may leave out a new-expression it can see is deleted
+    void* one = operator new(4, nothrow);
+    void* many = operator new[](100, nothrow);
+    void* array = operator new[](80);
+    void* lines = operator new[](192, align_val_t(64), nothrow);
+    EXPECT_EQUAL(numHeapAllocations() - before, 4);
+    EXPECT_EQUAL(numHeapBytesInUse() - bytesBefore, 4 + 100 + 80 + 192);
+    operator delete(one, nothrow);
+    operator delete[](many);
+    operator delete[](array, 80);
+    operator delete[](lines, align_val_t(64), nothrow);
+    EXPECT_EQUAL(numHeapBytesInUse(), bytesBefore);
+
+    // stable_sort takes its buffer from the nothrow form
+    vector<int> values = { 5, 3, 9, 1, 7, 2, 8 };
+    stable_sort(values.begin(), values.end());
+    EXPECT(is_sorted(values.begin(), values.end()));
+    EXPECT_EQUAL(numHeapBytesInUse(), bytesBefore + (long long) (values.capacity() * sizeof(int)));
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+/**
+ * Returns the number of calls made to the global operator new so far in
+ * this program. Tests take the difference across a block of code to
+ * check how many heap allocations that code made.
+ */
+long numHeapAllocations();
+
+/**
+ * Returns the number of bytes currently allocated through the global
+ * operator new and not yet deleted. Tests take the difference across a
+ * block of code to see how much memory the structures it built hold on to.
+ */
+long long numHeapBytesInUse();
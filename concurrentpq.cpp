@@ -0,0 +1,230 @@
+/* A MultiQueue of PQHeap shards for many producers and consumers, with a
+ * strict single-heap mode.
+ */
+#include "concurrentpq.h"
+#include "error.h"
+#include "strlib.h"
+#include "vector.h"
+#include <climits>
+#include <functional>
+#include <random>
+#include <thread>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/* Each thread picks shards with its own generator, so picking doesn't
+ * need a lock.
+ */
+static int randomShard(int numShards) {
+    thread_local minstd_rand generator(hash<thread::id>()(this_thread::get_id()));
+    return generator() % numShards;
+}
+
+ConcurrentPQ::ConcurrentPQ(int numThreads, Mode mode, int shardsPerThread) {
+    if (numThreads < 1 || shardsPerThread < 1)
+        error("ConcurrentPQ needs at least one thread and one shard per thread");
+    _mode = mode;
+    _numShards = mode == Mode::Strict ? 1 : numThreads * shardsPerThread;
+    _shards.reset(new Shard[_numShards]);
+    for (int i = 0; i < _numShards; i++) {
+        _shards[i].frontPriority = INT_MAX;
+    }
+    _size = 0;
+}
+
+void ConcurrentPQ::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * Tries random shards until one is free. If every try finds a busy shard,
+ * the last one is waited on rather than spinning any longer.
+ */
+void ConcurrentPQ::enqueue(DataPoint&& elem) {
+    for (int attempt = 0; attempt < _numShards; attempt++) {
+        Shard& shard = _shards[randomShard(_numShards)];
+        if (shard.lock.try_lock()) {
+            enqueueLocked(shard, std::move(elem));
+            shard.lock.unlock();
+            return;
+        }
+    }
+    Shard& shard = _shards[randomShard(_numShards)];
+    lock_guard<mutex> guard(shard.lock);
+    enqueueLocked(shard, std::move(elem));
+}
+
+/*
+ * Picks the better front of two random shards and takes it if its lock is
+ * free. After a few misses, or once the sampled shards look empty, every
+ * shard is checked in turn so that false is only returned when the queue
+ * really was empty.
+ */
+bool ConcurrentPQ::tryDequeue(DataPoint& out) {
+    if (_mode == Mode::Strict) {
+        lock_guard<mutex> guard(_shards[0].lock);
+        return dequeueLocked(_shards[0], out);
+    }
+    for (int attempt = 0; attempt < _numShards && _size.load(memory_order_relaxed) > 0; attempt++) {
+        Shard& first = _shards[randomShard(_numShards)];
+        Shard& second = _shards[randomShard(_numShards)];
+        Shard& best = first.frontPriority.load(memory_order_relaxed) <= second.frontPriority.load(memory_order_relaxed) ? first : second;
+        if (best.frontPriority.load(memory_order_relaxed) == INT_MAX) continue;
+        if (best.lock.try_lock()) {
+            bool found = dequeueLocked(best, out);
+            best.lock.unlock();
+            if (found) return true;
+        }
+    }
+    for (int i = 0; i < _numShards; i++) {
+        lock_guard<mutex> guard(_shards[i].lock);
+        if (dequeueLocked(_shards[i], out)) return true;
+    }
+    return false;
+}
+
+int ConcurrentPQ::size() const {
+    return _size.load();
+}
+
+bool ConcurrentPQ::isEmpty() const {
+    return size() == 0;
+}
+
+/*
+ * The caller holds the shard's lock.
+ */
+void ConcurrentPQ::enqueueLocked(Shard& shard, DataPoint&& elem) {
+    if (elem.priority < shard.frontPriority.load(memory_order_relaxed)) {
+        shard.frontPriority.store(elem.priority, memory_order_relaxed);
+    }
+    shard.heap.enqueue(std::move(elem));
+    _size.fetch_add(1);
+}
+
+/*
+ * The caller holds the shard's lock. Returns false if the shard is empty.
+ */
+bool ConcurrentPQ::dequeueLocked(Shard& shard, DataPoint& out) {
+    if (shard.heap.isEmpty()) return false;
+    out = shard.heap.dequeue();
+    shard.frontPriority.store(shard.heap.isEmpty() ? INT_MAX : shard.heap.peekPriority(), memory_order_relaxed);
+    _size.fetch_sub(1);
+    return true;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("ConcurrentPQ strict mode dequeues in exact order") {
+    ConcurrentPQ pq(4, ConcurrentPQ::Mode::Strict);
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+    }
+    EXPECT_EQUAL(pq.size(), 9);
+    DataPoint cur;
+    for (int i = 1; i <= 9; i++) {
+        EXPECT(pq.tryDequeue(cur));
+        EXPECT_EQUAL(cur.priority, i);
+    }
+    EXPECT(!pq.tryDequeue(cur));
+    EXPECT(pq.isEmpty());
+}
+
+STUDENT_TEST("ConcurrentPQ relaxed mode single thread loses nothing") {
+    ConcurrentPQ pq(4);
+    for (int i = 0; i < 1000; i++) {
+        pq.enqueue({ "", i });
+    }
+    Vector<int> seen(1000, 0);
+    DataPoint cur;
+    while (pq.tryDequeue(cur)) {
+        seen[cur.priority]++;
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQUAL(seen[i], 1);
+    }
+    EXPECT_ERROR(ConcurrentPQ(0));
+}
+
+/* Runs numThreads threads that each enqueue perThread elements with ids unique to the thread and interleave
+ * dequeues, then drain the queue. Returns how many times each id came out.
+ */
+static Vector<int> stressCounts(ConcurrentPQ& pq, int numThreads, int perThread) {
+    vector<vector<int>> dequeuedIds(numThreads);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+        workers.emplace_back([&, t]() {
+            minstd_rand generator(t + 1);
+            DataPoint cur;
+            for (int i = 0; i < perThread; i++) {
+                int id = t * perThread + i;
+                pq.enqueue({ integerToString(id), (int) (generator() % 1000) });
+                if (i % 2 == 1 && pq.tryDequeue(cur)) {
+                    dequeuedIds[t].push_back(stringToInteger(cur.label));
+                }
+            }
+            while (pq.tryDequeue(cur)) {
+                dequeuedIds[t].push_back(stringToInteger(cur.label));
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    Vector<int> counts(numThreads * perThread, 0);
+    for (const vector<int>& ids : dequeuedIds) {
+        for (int id : ids) {
+            counts[id]++;
+        }
+    }
+    return counts;
+}
+
+STUDENT_TEST("ConcurrentPQ multi-threaded stress test, no element lost or duplicated") {
+    for (ConcurrentPQ::Mode mode : { ConcurrentPQ::Mode::Relaxed, ConcurrentPQ::Mode::Strict }) {
+        int numThreads = 8;
+        ConcurrentPQ pq(numThreads, mode);
+        Vector<int> counts = stressCounts(pq, numThreads, 20000);
+        int numWrong = 0;
+        for (int count : counts) {
+            if (count != 1) numWrong++;
+        }
+        EXPECT_EQUAL(numWrong, 0);
+        EXPECT(pq.isEmpty());
+    }
+}
+
+/* Has each of numThreads threads do its share of ops enqueue/tryDequeue pairs. */
+static void throughput(ConcurrentPQ& pq, int numThreads, int ops) {
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+        workers.emplace_back([&, t]() {
+            minstd_rand generator(t + 1);
+            DataPoint cur;
+            for (int i = 0; i < ops / numThreads; i++) {
+                pq.enqueue({ "", (int) (generator() % 1000000) });
+                pq.tryDequeue(cur);
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+STUDENT_TEST("ConcurrentPQ throughput at 1, 2, 4, 8 and 16 threads") {
+    int ops = 1000000;
+    for (int numThreads = 1; numThreads <= 16; numThreads *= 2) {
+        ConcurrentPQ relaxed(numThreads);
+        ConcurrentPQ strict(numThreads, ConcurrentPQ::Mode::Strict);
+        for (int i = 0; i < 100000; i++) {
+            relaxed.enqueue({ "", i });
+            strict.enqueue({ "", i });
+        }
+        TIME_OPERATION(numThreads, throughput(relaxed, numThreads, ops));
+        TIME_OPERATION(numThreads, throughput(strict, numThreads, ops));
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "datapoint.h"
+#include "pqheap.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/**
+ * A priority queue that many threads can enqueue into and dequeue from at
+ * the same time.
+ *
+ * In relaxed mode (the default) it is a MultiQueue: c * T PQHeap shards,
+ * for T threads, each behind its own lock. enqueue puts an element into a
+ * random shard whose lock it can get without waiting. tryDequeue looks at
+ * the fronts of two random shards and takes the smaller one. Threads rarely
+ * wait on each other, at the cost of order: an element dequeued is close
+ * to, but not always, the smallest one in the queue.
+ *
+ * In strict mode there is one PQHeap behind one lock, so dequeue order is
+ * exact and the queue scales like a PQHeap behind a global mutex.
+ */
+class ConcurrentPQ {
+public:
+    enum class Mode { Relaxed, Strict };
+
+    /**
+     * Creates an empty queue for the given number of threads. In relaxed
+     * mode it has shardsPerThread shards per thread.
+     */
+    ConcurrentPQ(int numThreads, Mode mode = Mode::Relaxed, int shardsPerThread = 2);
+
+    /**
+     * Adds an element to the queue. Safe to call from any thread.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Removes an element with a small priority into out and returns true,
+     * or returns false if the queue is empty. In strict mode the element
+     * is always the one with the smallest priority. Safe to call from any
+     * thread.
+     */
+    bool tryDequeue(DataPoint& out);
+
+    /**
+     * Returns the number of elements in the queue. With other threads
+     * running, the count may already be out of date when it returns.
+     */
+    int size() const;
+
+    /**
+     * Returns whether size() is zero.
+     */
+    bool isEmpty() const;
+
+private:
+    /* Each shard gets its own cache lines so that locking one doesn't slow
+     * down threads working on its neighbors.
+     */
+    struct alignas(64) Shard {
+        std::mutex lock;
+        PQHeap heap;
+        std::atomic<int> frontPriority;     // priority of the heap's front, INT_MAX if empty
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+    int _numShards;
+    Mode _mode;
+    std::atomic<int> _size;
+
+    void enqueueLocked(Shard& shard, DataPoint&& element);
+    bool dequeueLocked(Shard& shard, DataPoint& out);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    ConcurrentPQ(const ConcurrentPQ &) = delete;
+    void operator=(const ConcurrentPQ &) = delete;
+};
@@ -0,0 +1,133 @@
+/* Tests for the DaryHeap template. The implementation lives in daryheap.h
+ * since the arity is a template parameter.
+ */
+#include "daryheap.h"
+#include "pqheap.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include "testing/SimpleTest.h"
+using namespace std;
+
+template <int D>
+static void checkWriteupExample() {
+    DaryHeap<D> pq;
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+
+    pq.validateInternalState();
+    for (auto dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.size(), 9);
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.peek().priority, i);
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+}
+
+template <int D>
+static void checkRandomCycle(int n) {
+    DaryHeap<D> pq;
+    DataPoint min = { "min", -106106106 };
+    DataPoint max = { "max", 106106106 };
+    pq.enqueue(max);
+    for (int i = 0; i < n; i++) {
+        pq.enqueue({ "", randomInteger(-10000, 10000) });
+    }
+    pq.enqueue(min);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.size(), n + 2);
+
+    EXPECT_EQUAL(pq.dequeue(), min);
+    int last = -10000;
+    for (int i = 0; i < n; i++) {
+        DataPoint cur = pq.dequeue();
+        EXPECT(cur.priority >= last);
+        last = cur.priority;
+    }
+    EXPECT_EQUAL(pq.dequeue(), max);
+    pq.clear();
+    EXPECT(pq.isEmpty());
+}
+
+STUDENT_TEST("DaryHeap example from writeup, D = 2, 3, 4, 8") {
+    checkWriteupExample<2>();
+    checkWriteupExample<3>();
+    checkWriteupExample<4>();
+    checkWriteupExample<8>();
+}
+
+STUDENT_TEST("DaryHeap stress test, cycle 10000 random elements in and out") {
+    checkRandomCycle<2>(10000);
+    checkRandomCycle<4>(10000);
+    checkRandomCycle<8>(10000);
+}
+
+template <int D>
+static long allocationsForCycle(int n) {
+    DaryHeap<D> pq;
+    for (int i = 0; i < n; i++) {
+        pq.emplace("a label too long for the small string buffer " + integerToString(i), randomInteger(0, n));
+    }
+    long before = numHeapAllocations();
+    for (int i = 0; i < 10 * n; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority += randomInteger(0, n);
+        pq.enqueue(std::move(cur));
+    }
+    long after = numHeapAllocations();
+    pq.validateInternalState();
+    return after - before;
+}
+
+STUDENT_TEST("DaryHeap steady-state enqueue/dequeue cycle does no allocations") {
+    EXPECT_EQUAL(allocationsForCycle<2>(1000), 0);
+    EXPECT_EQUAL(allocationsForCycle<4>(1000), 0);
+    EXPECT_EQUAL(allocationsForCycle<8>(1000), 0);
+}
+
+template <typename PQ>
+static void fillQueue(PQ& pq, int n) {
+    pq.clear(); // start with empty queue
+    for (int i = 0; i < n; i++) {
+        pq.enqueue({ "", randomInteger(0, n) });
+    }
+}
+
+template <typename PQ>
+static void emptyQueue(PQ& pq, int n) {
+    for (int i = 0; i < n; i++) {
+        pq.dequeue();
+    }
+}
+
+template <typename PQ>
+static void timeQueue(int n) {
+    PQ pq;
+    TIME_OPERATION(n, fillQueue(pq, n));
+    TIME_OPERATION(n, emptyQueue(pq, n));
+}
+
+STUDENT_TEST("DaryHeap timing test, same sizes as PQHeap timing test") {
+    timeQueue<PQHeap>(40000);
+    timeQueue<DaryHeap<2>>(40000);
+    timeQueue<DaryHeap<4>>(40000);
+    timeQueue<DaryHeap<8>>(40000);
+}
+
+STUDENT_TEST("DaryHeap timing test, 1M and 10M elements for each arity") {
+    for (int n = 1000000; n <= 10000000; n *= 10) {
+        timeQueue<PQHeap>(n);
+        timeQueue<DaryHeap<2>>(n);
+        timeQueue<DaryHeap<4>>(n);
+        timeQueue<DaryHeap<8>>(n);
+    }
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "datapoint.h"
+#include "error.h"
+#include "simdkernels.h"
+#include "strlib.h"
+#include <string>
+#include <utility>
+
+/**
+ * Priority queue type implemented using a d-ary min-heap stored in a
+ * dynamic array. It has the same interface as PQHeap, but each node has
+ * D children instead of two. A wider node makes the tree shallower and
+ * keeps all the children of a node next to each other in memory, so for
+ * D = 4 or 8 bubbling down touches one or two cache lines per level
+ * instead of missing the cache on almost every level.
+ *
+ * The priorities are also kept in a packed int array next to the
+ * elements, so the D children of a node have their priorities in D
+ * consecutive ints. For D of 4 or more, the smallest child is found with
+ * the SIMD minIndex kernel, which for D = 8 is one AVX2 min and compare.
+ *
+ * The arity is picked at compile time, e.g. DaryHeap<4> pq;
+ */
+template <int D>
+class DaryHeap {
+public:
+    static_assert(D >= 2, "DaryHeap needs at least two children per node");
+
+    /**
+     * Creates a new, empty priority queue.
+     */
+    DaryHeap();
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~DaryHeap();
+
+    /**
+     * Adds a new element into the queue. This operation runs in
+     * time O(log N / log D). The rvalue version moves the element in
+     * without copying its label.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Adds a new element with the given label and priority into the queue.
+     */
+    void emplace(std::string label, int priority);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     * This operation runs in time O(D log N / log D).
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Confirms the internal state of the member variables appears
+     * valid and calls error() if the heap property is violated.
+     */
+    void validateInternalState();
+
+private:
+    DataPoint* _elements;   // dynamic array
+    int* _priorities;       // priority of each element, packed for the SIMD kernels
+    int _numAllocated;      // number of slots allocated in array
+    int _numFilled;         // number of slots filled in array
+
+    static int getParentIndex(int curIndex);
+    static int getFirstChildIndex(int curIndex);
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    DaryHeap(const DaryHeap &) = delete;
+    void operator=(const DaryHeap &) = delete;
+};
+
+/* * * * * * Implementation Below This Point * * * * * */
+
+template <int D>
+DaryHeap<D>::DaryHeap() {
+    _numAllocated = 16;
+    _elements = new DataPoint[_numAllocated];
+    _priorities = new int[_numAllocated];
+    _numFilled = 0;
+}
+
+template <int D>
+DaryHeap<D>::~DaryHeap() {
+    delete[] _elements;
+    delete[] _priorities;
+}
+
+/*
+ * Bubbles the new element up by sliding each larger parent down into the
+ * hole and only writing the new element once, into its final spot.
+ */
+template <int D>
+void DaryHeap<D>::enqueue(DataPoint&& elem) {
+    ensureCapacity(_numFilled + 1);
+    int hole = _numFilled;
+    while (hole > 0) {
+        int parent = getParentIndex(hole);
+        if (_priorities[parent] <= elem.priority)
+            break;
+        _elements[hole] = std::move(_elements[parent]);
+        _priorities[hole] = _priorities[parent];
+        hole = parent;
+    }
+    _priorities[hole] = elem.priority;
+    _elements[hole] = std::move(elem);
+    _numFilled++;
+}
+
+template <int D>
+void DaryHeap<D>::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+template <int D>
+void DaryHeap<D>::emplace(std::string label, int priority) {
+    enqueue(DataPoint{ std::move(label), priority });
+}
+
+/*
+ * Removes the root, then bubbles the last element down from the root,
+ * moving the smallest of the (up to) D children up into the hole at
+ * each level.
+ */
+template <int D>
+DataPoint DaryHeap<D>::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    DataPoint result = std::move(_elements[0]);
+    _numFilled--;
+    if (_numFilled > 0) {
+        DataPoint last = std::move(_elements[_numFilled]);
+        int hole = 0;
+        while (true) {
+            int first = getFirstChildIndex(hole);
+            if (first >= _numFilled)
+                break;
+            int end = first + D < _numFilled ? first + D : _numFilled;
+            int smallest = first;
+            if constexpr (D >= 4) {
+                smallest += minIndex(_priorities + first, end - first);
+            } else {
+                for (int i = first + 1; i < end; i++) {
+                    if (_priorities[i] < _priorities[smallest])
+                        smallest = i;
+                }
+            }
+            if (last.priority <= _priorities[smallest])
+                break;
+            _elements[hole] = std::move(_elements[smallest]);
+            _priorities[hole] = _priorities[smallest];
+            hole = smallest;
+        }
+        _priorities[hole] = last.priority;
+        _elements[hole] = std::move(last);
+    }
+    return result;
+}
+
+template <int D>
+DataPoint DaryHeap<D>::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _elements[0];
+}
+
+template <int D>
+bool DaryHeap<D>::isEmpty() const {
+    return size() == 0;
+}
+
+template <int D>
+int DaryHeap<D>::size() const {
+    return _numFilled;
+}
+
+template <int D>
+void DaryHeap<D>::clear() {
+    _numFilled = 0;
+}
+
+/*
+ * Every element except the root must have a priority no smaller than
+ * the priority of its parent, and the packed priorities must match.
+ */
+template <int D>
+void DaryHeap<D>::validateInternalState() {
+    if (_numFilled > _numAllocated) error("Too many elements in not enough space!");
+
+    for (int i = 0; i < size(); i++) {
+        if (_priorities[i] != _elements[i].priority)
+            error("Packed priority out of date at index " + integerToString(i));
+    }
+    for (int i = 1; i < size(); i++) {
+        if (_elements[getParentIndex(i)].priority > _elements[i].priority)
+            error("Array elements out of order at index " + integerToString(i));
+    }
+}
+
+template <int D>
+int DaryHeap<D>::getParentIndex(int curIndex) {
+    return (curIndex - 1) / D;
+}
+
+template <int D>
+int DaryHeap<D>::getFirstChildIndex(int curIndex) {
+    return D * curIndex + 1;
+}
+
+/*
+ * Doubles both arrays whenever they run out of room, moving the elements
+ * across rather than copying them.
+ */
+template <int D>
+void DaryHeap<D>::ensureCapacity(int numNeeded) {
+    if (numNeeded <= _numAllocated)
+        return;
+    int newAllocated = _numAllocated * 2 > numNeeded ? _numAllocated * 2 : numNeeded;
+    DataPoint* newElements = new DataPoint[newAllocated];
+    int* newPriorities = new int[newAllocated];
+    for (int i = 0; i < _numFilled; i++) {
+        newElements[i] = std::move(_elements[i]);
+        newPriorities[i] = _priorities[i];
+    }
+    delete[] _elements;
+    delete[] _priorities;
+    _elements = newElements;
+    _priorities = newPriorities;
+    _numAllocated = newAllocated;
+}
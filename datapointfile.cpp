@@ -0,0 +1,227 @@
+/* Writer and memory-mapped reader for the binary DataPoint file format. */
+#include "datapointfile.h"
+#include "datapointreader.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static const char kMagic[8] = { 'P', 'Q', 'D', 'P', 'B', 'I', 'N', '1' };
+static const uint64_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint64_t);
+
+/* Rounds n up to the next multiple of 8. */
+static uint64_t padTo8(uint64_t n) {
+    return (n + 7) & ~(uint64_t) 7;
+}
+
+/*
+ * A placeholder header is written first and patched in finish(), once the
+ * record count and blob size are known.
+ */
+DataPointFileWriter::DataPointFileWriter(const string& path) {
+    _out.open(path, ios::binary | ios::trunc);
+    if (!_out) error("Cannot create file " + path);
+    char header[kHeaderSize] = {};
+    _out.write(header, kHeaderSize);
+    _labelOffsets.push_back(0);
+    _finished = false;
+}
+
+/*
+ * A destructor must not throw, so a write error here is dropped; call
+ * finish() directly to find out about one.
+ */
+DataPointFileWriter::~DataPointFileWriter() {
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+void DataPointFileWriter::add(const DataPoint& elem) {
+    add(elem.label, elem.priority);
+}
+
+void DataPointFileWriter::add(string_view label, int priority) {
+    if (_finished) error("Cannot add to a finished DataPoint file");
+    _out.write(label.data(), label.size());
+    _priorities.push_back(priority);
+    _labelOffsets.push_back(_labelOffsets.back() + label.size());
+}
+
+void DataPointFileWriter::finish() {
+    if (_finished) return;
+    _finished = true;
+    uint64_t count = _priorities.size();
+    uint64_t blobBytes = _labelOffsets.back();
+    char padding[8] = {};
+
+    _out.write(padding, padTo8(blobBytes) - blobBytes);
+    _out.write((const char*) _priorities.data(), count * sizeof(int32_t));
+    _out.write(padding, padTo8(count * sizeof(int32_t)) - count * sizeof(int32_t));
+    _out.write((const char*) _labelOffsets.data(), (count + 1) * sizeof(uint64_t));
+
+    _out.seekp(0);
+    _out.write(kMagic, sizeof(kMagic));
+    _out.write((const char*) &count, sizeof(count));
+    _out.write((const char*) &blobBytes, sizeof(blobBytes));
+    _out.close();
+    if (_out.fail()) error("Error writing DataPoint file");
+}
+
+int convertToBinary(istream& in, const string& path) {
+    DataPointReader reader(in);
+    DataPointFileWriter writer(path);
+    DataPointView cur;
+    int count = 0;
+    while (reader.next(cur)) {
+        writer.add(cur.label, cur.priority);
+        count++;
+    }
+    if (reader.failed()) error("Malformed DataPoint text while converting to " + path);
+    writer.finish();
+    return count;
+}
+
+/*
+ * Maps the whole file and checks that the sections the header describes
+ * fit inside it, so later lookups can trust the offsets.
+ */
+MappedDataPointFile::MappedDataPointFile(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) error("Cannot open file " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < kHeaderSize) {
+        close(fd);
+        error("Not a DataPoint file: " + path);
+    }
+    _length = info.st_size;
+    void* mapping = mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) error("Cannot map file " + path);
+    _base = (char*) mapping;
+
+    uint64_t count, blobBytes;
+    memcpy(&count, _base + sizeof(kMagic), sizeof(count));
+    memcpy(&blobBytes, _base + sizeof(kMagic) + sizeof(count), sizeof(blobBytes));
+    uint64_t prioritiesStart = kHeaderSize + padTo8(blobBytes);
+    uint64_t offsetsStart = prioritiesStart + padTo8(count * sizeof(int32_t));
+    bool valid = memcmp(_base, kMagic, sizeof(kMagic)) == 0
+            && count <= INT_MAX
+            && blobBytes <= _length
+            && offsetsStart + (count + 1) * sizeof(uint64_t) == _length;
+    if (valid) {
+        _count = count;
+        _blob = _base + kHeaderSize;
+        _priorities = (const int32_t*) (_base + prioritiesStart);
+        _labelOffsets = (const uint64_t*) (_base + offsetsStart);
+        valid = _labelOffsets[_count] == blobBytes;
+    }
+    if (!valid) {
+        munmap(_base, _length);
+        error("Not a DataPoint file: " + path);
+    }
+}
+
+MappedDataPointFile::~MappedDataPointFile() {
+    munmap(_base, _length);
+}
+
+int MappedDataPointFile::size() const {
+    return _count;
+}
+
+int MappedDataPointFile::priority(int i) const {
+    if (i < 0 || i >= _count) error("Record index out of range: " + integerToString(i));
+    return _priorities[i];
+}
+
+string_view MappedDataPointFile::label(int i) const {
+    if (i < 0 || i >= _count) error("Record index out of range: " + integerToString(i));
+    uint64_t start = _labelOffsets[i];
+    uint64_t end = _labelOffsets[i + 1];
+    if (start > end || end > _labelOffsets[_count]) error("Corrupt label offset at record " + integerToString(i));
+    return string_view(_blob + start, end - start);
+}
+
+DataPoint MappedDataPointFile::get(int i) const {
+    return { string(label(i)), priority(i) };
+}
+
+void MappedDataPointFile::adviseSequential() const {
+    madvise(_base, _length, MADV_SEQUENTIAL);
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+static string tempPath(const string& name) {
+    return (filesystem::temp_directory_path() / name).string();
+}
+
+STUDENT_TEST("Binary DataPoint file round trip") {
+    Vector<DataPoint> input = {
+        { "A", 1 }, { "", -2 }, { "with space", 2147483647 }, { "odd length", -2147483647 - 1 },
+        { string("embedded\0nul", 12), 5 } };
+    string path = tempPath("datapointfile-test.bin");
+    {
+        DataPointFileWriter writer(path);
+        for (const DataPoint& pt : input) {
+            writer.add(pt);
+        }
+    }
+    MappedDataPointFile file(path);
+    EXPECT_EQUAL(file.size(), input.size());
+    for (int i = 0; i < input.size(); i++) {
+        EXPECT_EQUAL(file.get(i), input[i]);
+        EXPECT_EQUAL(file.priority(i), input[i].priority);
+    }
+    EXPECT_ERROR(file.get(-1));
+    EXPECT_ERROR(file.priority(input.size()));
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("convertToBinary from the text format, and rejecting bad files") {
+    stringstream text;
+    Vector<DataPoint> input;
+    for (int i = 0; i < 1000; i++) {
+        DataPoint pt = { "label " + integerToString(i), randomInteger(-100, 100) };
+        input.add(pt);
+        text << pt << "\n";
+    }
+    string path = tempPath("datapointfile-test.bin");
+    EXPECT_EQUAL(convertToBinary(text, path), 1000);
+    {
+        MappedDataPointFile file(path);
+        EXPECT_EQUAL(file.size(), 1000);
+        for (int i = 0; i < 1000; i++) {
+            EXPECT_EQUAL(file.get(i), input[i]);
+        }
+    }
+
+    stringstream empty;
+    EXPECT_EQUAL(convertToBinary(empty, path), 0);
+    {
+        MappedDataPointFile file(path);
+        EXPECT_EQUAL(file.size(), 0);
+    }
+
+    {
+        ofstream out(path);
+        out << "not a DataPoint file at all, just some text";
+    }
+    EXPECT_ERROR(MappedDataPointFile{ path });
+    stringstream malformed("{ \"a\", 1 } oops");
+    EXPECT_ERROR(convertToBinary(malformed, path));
+    filesystem::remove(path);
+    EXPECT_ERROR(MappedDataPointFile{ path });
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "datapoint.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Compact binary format for a sequence of DataPoints, so that a dump can be
+ * parsed once and then memory-mapped and used as-is any number of times.
+ * All numbers are in the byte order of the machine that wrote the file.
+ *
+ *     header         "PQDPBIN1", then the record count and the blob size
+ *                    as 64-bit integers (24 bytes)
+ *     label blob     all labels back to back, padded to a multiple of 8
+ *     priorities     one 32-bit priority per record, padded to a multiple of 8
+ *     label offsets  count + 1 64-bit offsets into the blob; the label of
+ *                    record i runs from offsets[i] to offsets[i + 1]
+ */
+
+/**
+ * Writes DataPoints to a file in the binary format. Labels go straight to
+ * the file as they are added. The priorities and label offsets are held in
+ * memory (12 bytes per record) until finish() writes them after the blob.
+ */
+class DataPointFileWriter {
+public:
+    /**
+     * Creates the file at path, replacing any file already there.
+     * Calls error() if the file can't be created.
+     */
+    DataPointFileWriter(const std::string& path);
+
+    /**
+     * Finishes the file if finish() hasn't been called yet.
+     */
+    ~DataPointFileWriter();
+
+    /**
+     * Appends one record to the file.
+     */
+    void add(const DataPoint& element);
+    void add(std::string_view label, int priority);
+
+    /**
+     * Writes the priorities and label offsets and closes the file. No more
+     * records may be added afterwards.
+     */
+    void finish();
+
+private:
+    std::ofstream _out;
+    std::vector<int32_t> _priorities;
+    std::vector<uint64_t> _labelOffsets;
+    bool _finished;
+
+    /* Weird C++isms: You're not allowed to copy or assign writers. */
+    DataPointFileWriter(const DataPointFileWriter &) = delete;
+    void operator=(const DataPointFileWriter &) = delete;
+};
+
+/**
+ * Reads DataPoints in the text format from the stream and writes them to
+ * the file at path in the binary format. Returns the number of records.
+ */
+int convertToBinary(std::istream& in, const std::string& path);
+
+/**
+ * A read-only memory mapping of a DataPoint file in the binary format.
+ * Opening the file only checks the header and maps it; records are read
+ * straight out of the mapping, so the cost of a scan is the page faults
+ * rather than any parsing.
+ */
+class MappedDataPointFile {
+public:
+    /**
+     * Maps the file at path. Calls error() if the file can't be opened or
+     * isn't a well-formed DataPoint file.
+     */
+    MappedDataPointFile(const std::string& path);
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedDataPointFile();
+
+    /**
+     * Returns the number of records in the file.
+     */
+    int size() const;
+
+    /**
+     * Returns the priority of record i, without touching its label.
+     */
+    int priority(int i) const;
+
+    /**
+     * Returns the label of record i as a view into the mapping, valid
+     * for as long as the file stays mapped.
+     */
+    std::string_view label(int i) const;
+
+    /**
+     * Returns record i as a DataPoint, copying its label.
+     */
+    DataPoint get(int i) const;
+
+    /**
+     * Tells the kernel the records will be read in order, so that it reads
+     * ahead of the reader in large chunks and can drop the pages behind it
+     * early.
+     */
+    void adviseSequential() const;
+
+private:
+    char* _base;                // start of the mapping
+    size_t _length;             // length of the mapping in bytes
+    int _count;                 // number of records
+    const char* _blob;          // label blob
+    const int32_t* _priorities; // priority array
+    const uint64_t* _labelOffsets;  // label offset table
+
+    /* Weird C++isms: You're not allowed to copy or assign mapped files. */
+    MappedDataPointFile(const MappedDataPointFile &) = delete;
+    void operator=(const MappedDataPointFile &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(MappedDataPointFile);
+};
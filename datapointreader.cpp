@@ -0,0 +1,405 @@
+/* A block-buffered, hand-rolled scanner for the DataPoint text format. */
+#include "datapointreader.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+DataPointReader::DataPointReader(istream& in, long long maxBytes, size_t blockSize) {
+    if (blockSize == 0) {
+        error("The block size must be positive");
+    }
+    _in = &in;
+    _fd = -1;
+    _bytesLeft = maxBytes;
+    _capacity = blockSize;
+    _buffer = new char[_capacity];
+    _begin = 0;
+    _end = 0;
+    _atEnd = false;
+    _failed = false;
+}
+
+DataPointReader::DataPointReader(int fd) {
+    _in = nullptr;
+    _fd = fd;
+    _bytesLeft = -1;
+    _capacity = kDefaultBlockSize;
+    _buffer = new char[_capacity];
+    _begin = 0;
+    _end = 0;
+    _atEnd = false;
+    _failed = false;
+}
+
+DataPointReader::~DataPointReader() {
+    delete[] _buffer;
+}
+
+/*
+ * Scans records out of the buffer, pulling in another block whenever the
+ * record at the front runs past the end of what has been read so far.
+ */
+bool DataPointReader::next(DataPointView& out) {
+    while (true) {
+        size_t recordEnd;
+        ScanResult result = scan(out, recordEnd);
+        if (result == ScanResult::Record) {
+            _begin = recordEnd;
+            return true;
+        }
+        if (result == ScanResult::Malformed) {
+            _failed = true;
+            return false;
+        }
+        if (!refill()) {
+            // Only whitespace may be left over at the end of the input.
+            for (size_t i = _begin; i < _end; i++) {
+                if (!isspace((unsigned char) _buffer[i])) {
+                    _failed = true;
+                    break;
+                }
+            }
+            _begin = _end;
+            return false;
+        }
+    }
+}
+
+bool DataPointReader::next(DataPoint& out) {
+    DataPointView view;
+    if (!next(view)) return false;
+    out.label.assign(view.label.data(), view.label.size());
+    out.priority = view.priority;
+    return true;
+}
+
+bool DataPointReader::next(InternedPoint& out, LabelPool& pool) {
+    DataPointView view;
+    if (!next(view)) return false;
+    out.labelId = pool.intern(view.label);
+    out.priority = view.priority;
+    return true;
+}
+
+bool DataPointReader::failed() const {
+    return _failed;
+}
+
+/*
+ * Slides the unscanned bytes to the front of the buffer, doubling it first
+ * if they already fill it, and reads as much more input as fits. Returns
+ * false if there is no more input, or if reading failed, in which case
+ * _failed is set. A read interrupted by a signal is tried again.
+ */
+bool DataPointReader::refill() {
+    if (_atEnd) return false;
+    size_t unscanned = _end - _begin;
+    if (unscanned == _capacity) {
+        char* bigger = new char[_capacity * 2];
+        memcpy(bigger, _buffer + _begin, unscanned);
+        delete[] _buffer;
+        _buffer = bigger;
+        _capacity *= 2;
+    } else {
+        memmove(_buffer, _buffer + _begin, unscanned);
+    }
+    _begin = 0;
+    _end = unscanned;
+
+    size_t wanted = _capacity - _end;
+    if (_bytesLeft >= 0 && (long long) wanted > _bytesLeft) {
+        wanted = _bytesLeft;
+    }
+    long long numRead = 0;
+    if (wanted > 0) {
+        if (_in != nullptr) {
+            _in->read(_buffer + _end, wanted);
+            numRead = _in->gcount();
+            if (_in->bad()) _failed = true;
+        } else {
+            do {
+                numRead = ::read(_fd, _buffer + _end, wanted);
+            } while (numRead < 0 && errno == EINTR);
+            if (numRead < 0) _failed = true;
+        }
+    }
+    if (numRead <= 0 || _failed) {
+        _atEnd = true;
+        return false;
+    }
+    _end += numRead;
+    if (_bytesLeft >= 0) _bytesLeft -= numRead;
+    return true;
+}
+
+/*
+ * Returns the value of an escape sequence starting just after the
+ * backslash at text[i], and advances i past it. Octal and hex escapes are
+ * accepted along with the usual single-character ones.
+ */
+static bool decodeEscape(const char* text, size_t end, size_t& i, char& decoded) {
+    if (i >= end) return false;
+    char ch = text[i++];
+    switch (ch) {
+        case 'n': decoded = '\n'; return true;
+        case 't': decoded = '\t'; return true;
+        case 'r': decoded = '\r'; return true;
+        case 'f': decoded = '\f'; return true;
+        case 'b': decoded = '\b'; return true;
+        case 'a': decoded = '\a'; return true;
+        case 'v': decoded = '\v'; return true;
+        case 'x': {
+            int value = 0;
+            int numDigits = 0;
+            while (i < end && isxdigit((unsigned char) text[i])) {
+                char digit = text[i++];
+                value = value * 16 + (isdigit((unsigned char) digit) ? digit - '0' : tolower(digit) - 'a' + 10);
+                numDigits++;
+            }
+            if (numDigits == 0) return false;
+            decoded = (char) value;
+            return true;
+        }
+        default:
+            if (ch >= '0' && ch <= '7') {
+                int value = ch - '0';
+                for (int n = 1; n < 3 && i < end && text[i] >= '0' && text[i] <= '7'; n++) {
+                    value = value * 8 + (text[i++] - '0');
+                }
+                decoded = (char) value;
+                return true;
+            }
+            decoded = ch;   // \\, \", \' and \? stand for themselves
+            return true;
+    }
+}
+
+/*
+ * Scans one record from the front of the buffer without consuming it.
+ * NeedMore means the buffer ended partway through the record, or before
+ * any record started.
+ */
+DataPointReader::ScanResult DataPointReader::scan(DataPointView& out, size_t& recordEnd) {
+    const char* text = _buffer;
+    size_t end = _end;
+    size_t i = _begin;
+
+    auto skipSpace = [&]() {
+        while (i < end && isspace((unsigned char) text[i])) i++;
+    };
+
+    skipSpace();
+    if (i >= end) return ScanResult::NeedMore;
+    if (text[i++] != '{') return ScanResult::Malformed;
+    skipSpace();
+    if (i >= end) return ScanResult::NeedMore;
+    if (text[i++] != '"') return ScanResult::Malformed;
+
+    size_t labelStart = i;
+    bool hasEscapes = false;
+    while (i < end && text[i] != '"') {
+        if (text[i] == '\\') {
+            hasEscapes = true;
+            i++;
+        }
+        i++;
+    }
+    if (i >= end) return ScanResult::NeedMore;
+    size_t labelEnd = i++;
+
+    skipSpace();
+    if (i >= end) return ScanResult::NeedMore;
+    if (text[i++] != ',') return ScanResult::Malformed;
+    skipSpace();
+    if (i >= end) return ScanResult::NeedMore;
+
+    bool negative = false;
+    if (text[i] == '-' || text[i] == '+') {
+        negative = text[i] == '-';
+        i++;
+    }
+    long long value = 0;
+    size_t digitsStart = i;
+    while (i < end && isdigit((unsigned char) text[i])) {
+        value = value * 10 + (text[i++] - '0');
+        if (value > (long long) INT_MAX + 1) return ScanResult::Malformed;
+    }
+    if (i >= end) return ScanResult::NeedMore;
+    if (i == digitsStart) return ScanResult::Malformed;
+    if (negative) value = -value;
+    if (value > INT_MAX || value < INT_MIN) return ScanResult::Malformed;
+
+    skipSpace();
+    if (i >= end) return ScanResult::NeedMore;
+    if (text[i++] != '}') return ScanResult::Malformed;
+
+    if (hasEscapes) {
+        _scratch.clear();
+        size_t j = labelStart;
+        while (j < labelEnd) {
+            char ch = text[j++];
+            if (ch == '\\' && !decodeEscape(text, labelEnd, j, ch)) return ScanResult::Malformed;
+            _scratch += ch;
+        }
+        out.label = _scratch;
+    } else {
+        out.label = string_view(text + labelStart, labelEnd - labelStart);
+    }
+    out.priority = (int) value;
+    recordEnd = i;
+    return ScanResult::Record;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+/* Reads every record out of the reader. */
+static Vector<DataPoint> readAll(DataPointReader& reader) {
+    Vector<DataPoint> result;
+    DataPoint cur;
+    while (reader.next(cur)) {
+        result.add(cur);
+    }
+    return result;
+}
+
+STUDENT_TEST("DataPointReader reads what operator<< writes") {
+    Vector<DataPoint> input = {
+        { "A", 1 }, { "", -2 }, { "with space", 2147483647 }, { "min", -2147483647 - 1 },
+        { "quote \" and backslash \\", 7 }, { "tab\tnewline\n", 8 }, { "} {", 9 } };
+    stringstream stream;
+    for (const DataPoint& pt : input) {
+        stream << pt;
+    }
+    DataPointReader reader(stream);
+    EXPECT_EQUAL(readAll(reader), input);
+    EXPECT(!reader.failed());
+}
+
+STUDENT_TEST("DataPointReader in interned mode hands out pool ids") {
+    stringstream stream("{ \"a\", 1 } { \"b\", 2 } { \"a\", 3 } { \"tab\\t\", 4 }");
+    LabelPool pool;
+    DataPointReader reader(stream);
+    InternedPoint cur;
+    Vector<int> ids;
+    while (reader.next(cur, pool)) {
+        ids.add(cur.labelId);
+    }
+    EXPECT(!reader.failed());
+    Vector<int> expected = { 0, 1, 0, 2 };
+    EXPECT_EQUAL(ids, expected);
+    EXPECT_EQUAL(string(pool.label(2)), "tab\t");
+    EXPECT_EQUAL(pool.toDataPoint(cur).priority, 4);
+}
+
+STUDENT_TEST("DataPointReader handles extra whitespace, escapes and records split across blocks") {
+    stringstream stream("  {\"a\",1}\n\t{  \"b\\x41\\101\" ,  +2 }   ");
+    DataPointReader reader(stream);
+    Vector<DataPoint> expected = { { "a", 1 }, { "bAA", 2 } };
+    EXPECT_EQUAL(readAll(reader), expected);
+    EXPECT(!reader.failed());
+
+    // one label bigger than a whole block forces the buffer to grow
+    string longLabel(3 * 1000 * 1000, 'x');
+    Vector<DataPoint> input;
+    for (int i = 0; i < 100000; i++) {
+        input.add({ integerToString(i), i });
+    }
+    input.add({ longLabel, -1 });
+    input.add({ "last", 0 });
+    stringstream big;
+    for (const DataPoint& pt : input) {
+        big << pt << " ";
+    }
+    DataPointReader bigReader(big);
+    EXPECT(readAll(bigReader) == input);
+
+    // blocks much smaller than a record
+    stringstream tiny("{ \"first\", 1 } { \"second\", 2 } { \"third\", 3 }");
+    DataPointReader tinyReader(tiny, -1, 3);
+    Vector<DataPoint> tinyExpected = { { "first", 1 }, { "second", 2 }, { "third", 3 } };
+    EXPECT_EQUAL(readAll(tinyReader), tinyExpected);
+    EXPECT(!tinyReader.failed());
+    EXPECT_ERROR(DataPointReader(tiny, -1, 0));
+}
+
+STUDENT_TEST("DataPointReader stops at malformed or truncated input") {
+    for (string text : { "{ \"a\", 1 } junk", "{ \"a\", 1 } { \"b\", 2", "{ \"a\" 1 }",
+                         "{ \"a\", 99999999999 }", "{ \"a\", }", "{ \"a\", 1 } {" }) {
+        stringstream stream(text);
+        DataPointReader reader(stream);
+        DataPointView view;
+        while (reader.next(view)) {}
+        EXPECT(reader.failed());
+    }
+}
+
+/* A stream buffer whose every read fails, like a disk that returns EIO. */
+class FailingBuffer : public streambuf {
+protected:
+    int_type underflow() override {
+        throw ios_base::failure("read error");
+    }
+};
+
+STUDENT_TEST("DataPointReader reports read errors instead of a clean end") {
+    FailingBuffer buffer;
+    istream stream(&buffer);
+    DataPointReader streamReader(stream);
+    DataPointView view;
+    EXPECT(!streamReader.next(view));
+    EXPECT(streamReader.failed());
+
+    DataPointReader fdReader(-1);
+    EXPECT(!fdReader.next(view));
+    EXPECT(fdReader.failed());
+}
+
+STUDENT_TEST("DataPointReader stops after maxBytes") {
+    stringstream stream("{ \"a\", 1 }{ \"b\", 2 }{ \"c\", 3 }");
+    DataPointReader reader(stream, 20);
+    Vector<DataPoint> expected = { { "a", 1 }, { "b", 2 } };
+    EXPECT_EQUAL(readAll(reader), expected);
+    EXPECT(!reader.failed());
+}
+
+static int sumWithOperator(istream& stream) {
+    DataPoint cur;
+    int sum = 0;
+    while (stream >> cur) {
+        sum += cur.priority;
+    }
+    return sum;
+}
+
+static int sumWithReader(istream& stream) {
+    DataPointReader reader(stream);
+    DataPointView cur;
+    int sum = 0;
+    while (reader.next(cur)) {
+        sum += cur.priority;
+    }
+    return sum;
+}
+
+STUDENT_TEST("DataPointReader time trial versus operator>>, 10M records") {
+    int n = 10000000;
+    stringstream text;
+    for (int i = 0; i < n; i++) {
+        text << DataPoint{ "", randomInteger(0, 100) } << " ";
+    }
+    string contents = text.str();
+    stringstream first(contents);
+    TIME_OPERATION(n, sumWithOperator(first));
+    stringstream second(contents);
+    TIME_OPERATION(n, sumWithReader(second));
+    stringstream third(contents), fourth(contents);
+    EXPECT_EQUAL(sumWithOperator(third), sumWithReader(fourth));
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "datapoint.h"
+#include "labelpool.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+/**
+ * A DataPoint whose label is a view into someone else's buffer instead of
+ * a string of its own. It is only valid until the reader that produced
+ * it reads the next record.
+ */
+struct DataPointView {
+    std::string_view label;
+    int priority;
+};
+
+/**
+ * Reads DataPoints written in the usual text format, { "label", priority },
+ * much faster than operator>>. Input is pulled in large blocks and scanned
+ * by hand instead of going through locale-aware formatted extraction one
+ * character at a time.
+ *
+ * Labels come back as views into the block buffer. Only a label that has
+ * escape sequences in it is decoded, into a scratch string owned by the
+ * reader.
+ */
+class DataPointReader {
+public:
+    /**
+     * Size of the blocks read from the input unless another is given. The
+     * buffer grows past the block size only if a single record is longer
+     * than a whole block.
+     */
+    static constexpr size_t kDefaultBlockSize = 1 << 20;
+
+    /**
+     * Creates a reader that pulls its input from the stream. If maxBytes
+     * is given, the reader stops after that many bytes, which lets it read
+     * one piece of a larger file. A smaller blockSize saves memory when
+     * many readers are open at once.
+     */
+    DataPointReader(std::istream& in, long long maxBytes = -1, size_t blockSize = kDefaultBlockSize);
+
+    /**
+     * Creates a reader that pulls its input from an open file descriptor.
+     * The descriptor is not closed by the reader.
+     */
+    DataPointReader(int fd);
+
+    /**
+     * Cleans up the block buffer.
+     */
+    ~DataPointReader();
+
+    /**
+     * Reads the next record. Returns false at the end of the input, or if
+     * the input isn't a well-formed record, in which case failed() becomes
+     * true. The view version doesn't build a string for the label.
+     */
+    bool next(DataPointView& out);
+    bool next(DataPoint& out);
+
+    /**
+     * Reads the next record in interned mode: its label is interned in
+     * the pool and only the id comes back. Returns false the same way as
+     * the other versions.
+     */
+    bool next(InternedPoint& out, LabelPool& pool);
+
+    /**
+     * Returns whether the reader stopped because of malformed input or a
+     * read error rather than because it reached the end after a whole
+     * number of records.
+     */
+    bool failed() const;
+
+private:
+    enum class ScanResult { Record, NeedMore, Malformed };
+
+    std::istream* _in;      // input stream, or nullptr when reading from _fd
+    int _fd;                // input file descriptor, or -1
+    long long _bytesLeft;   // bytes the reader may still pull, -1 for no limit
+    char* _buffer;          // block buffer
+    size_t _capacity;       // size of _buffer
+    size_t _begin;          // first unscanned byte in _buffer
+    size_t _end;            // one past the last filled byte in _buffer
+    bool _atEnd;            // no more input to pull
+    bool _failed;           // stopped on malformed input
+    std::string _scratch;   // decoded label, when it has escapes
+
+    bool refill();
+    ScanResult scan(DataPointView& out, size_t& recordEnd);
+
+    /* Weird C++isms: You're not allowed to copy or assign readers. */
+    DataPointReader(const DataPointReader &) = delete;
+    void operator=(const DataPointReader &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(DataPointReader);
+};
@@ -0,0 +1,129 @@
+/* A thread-safe pool of interned labels, and the memory that interning
+ * saves in a queue.
+ */
+#include "labelpool.h"
+#include "pqheap.h"
+#include "pqkeyheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+LabelPool::LabelPool() {}
+
+/*
+ * Looks the label up under the shared lock first, since almost every label
+ * in a feed has been seen before. A miss takes the exclusive lock and looks
+ * again, in case another thread added the label in between.
+ */
+uint32_t LabelPool::intern(string_view label) {
+    {
+        shared_lock<shared_mutex> reading(_lock);
+        auto found = _ids.find(label);
+        if (found != _ids.end()) return found->second;
+    }
+    unique_lock<shared_mutex> writing(_lock);
+    auto found = _ids.find(label);
+    if (found != _ids.end()) return found->second;
+    uint32_t id = _labels.size();
+    _labels.emplace_back(label);
+    _ids.emplace(_labels.back(), id);
+    return id;
+}
+
+string_view LabelPool::label(uint32_t id) const {
+    shared_lock<shared_mutex> reading(_lock);
+    if (id >= _labels.size()) error("No label with id " + integerToString(id));
+    return _labels[id];
+}
+
+DataPoint LabelPool::toDataPoint(const InternedPoint& point) const {
+    return { string(label(point.labelId)), point.priority };
+}
+
+int LabelPool::size() const {
+    shared_lock<shared_mutex> reading(_lock);
+    return _labels.size();
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("LabelPool gives each distinct label one id") {
+    LabelPool pool;
+    EXPECT_EQUAL(pool.intern("apple"), 0u);
+    EXPECT_EQUAL(pool.intern("banana"), 1u);
+    EXPECT_EQUAL(pool.intern("apple"), 0u);
+    EXPECT_EQUAL(pool.intern(""), 2u);
+    EXPECT_EQUAL(pool.size(), 3);
+    EXPECT_EQUAL(string(pool.label(1)), "banana");
+    DataPoint expected = { "apple", 7 };
+    EXPECT_EQUAL(pool.toDataPoint({ 0, 7 }), expected);
+    EXPECT_ERROR(pool.label(3));
+}
+
+STUDENT_TEST("LabelPool interning from several threads agrees on the ids") {
+    LabelPool pool;
+    int numThreads = 8;
+    int numLabels = 2000;
+    vector<vector<uint32_t>> ids(numThreads, vector<uint32_t>(numLabels));
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < numLabels; i++) {
+                int which = (i + 37 * t) % numLabels;
+                ids[t][which] = pool.intern("label " + integerToString(which));
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    EXPECT_EQUAL(pool.size(), numLabels);
+    int numWrong = 0;
+    for (int i = 0; i < numLabels; i++) {
+        for (int t = 0; t < numThreads; t++) {
+            if (ids[t][i] != ids[0][i]) numWrong++;
+        }
+        if (string(pool.label(ids[0][i])) != "label " + integerToString(i)) numWrong++;
+    }
+    EXPECT_EQUAL(numWrong, 0);
+}
+
+STUDENT_TEST("Memory saved per million elements by interning labels") {
+    int n = 1000000;
+    Vector<string> labels;
+    for (int i = 0; i < 1000; i++) {
+        labels.add("feed/source-" + integerToString(i) + "/event-type");
+    }
+
+    long long before = numHeapBytesInUse();
+    long long plainBytes;
+    {
+        PQHeap plain;
+        for (int i = 0; i < n; i++) {
+            plain.enqueue({ labels[i % labels.size()], randomInteger(0, n) });
+        }
+        plainBytes = numHeapBytesInUse() - before;
+    }
+
+    before = numHeapBytesInUse();
+    long long internedBytes;
+    {
+        LabelPool pool;
+        PQKeyHeap interned(pool);
+        for (int i = 0; i < n; i++) {
+            interned.enqueue({ labels[i % labels.size()], randomInteger(0, n) });
+        }
+        internedBytes = numHeapBytesInUse() - before;
+    }
+    cout << "    MEMORY per million elements: PQHeap " << plainBytes / 1000000.0 << " MB, "
+         << "interned PQKeyHeap " << internedBytes / 1000000.0 << " MB, saved "
+         << (plainBytes - internedBytes) / 1000000.0 << " MB" << endl;
+    EXPECT(internedBytes * 4 < plainBytes);
+}
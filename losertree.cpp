@@ -0,0 +1,307 @@
+/* A tournament tree of losers for merging sorted DataPoint streams. Used by
+ * mergeSorted in pqclient.cpp.
+ */
+#include "losertree.h"
+#include "pqindexedheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include <algorithm>
+#include <climits>
+#include <sstream>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/* The key of a stream that has no more records. Real keys are always
+ * smaller, since no stream index is all ones.
+ */
+static const uint64_t kExhausted = UINT64_MAX;
+
+/* Orders keys by priority and then by stream index. Flipping the sign bit
+ * makes the unsigned order of priorities match their signed order.
+ */
+static uint64_t keyOf(int priority, int stream) {
+    return ((uint64_t) ((uint32_t) priority ^ 0x80000000u) << 32) | (uint32_t) stream;
+}
+
+/*
+ * The tree is laid out like a heap: node n has children 2n and 2n + 1, and
+ * stream i is the leaf at k + i. That gives every internal node two
+ * children for any k, not just powers of two. The first matches are played
+ * bottom-up with a scratch array of winners, which the tree doesn't need
+ * once every node has its loser.
+ */
+LoserTreeMerge::LoserTreeMerge(const Vector<istream*>& streams, size_t blockSize) {
+    _k = streams.size();
+    _heads.resize(_k);
+    _keys.assign(_k, 0);
+    for (int i = 0; i < _k; i++) {
+        if (streams[i] == nullptr) {
+            error("Stream " + integerToString(i) + " is null");
+        }
+        _readers.push_back(make_unique<DataPointReader>(*streams[i], -1, blockSize));
+        advance(i);
+    }
+
+    _tree.assign(max(_k, 1), 0);
+    vector<int> winners(2 * _k);
+    for (int i = 0; i < _k; i++) {
+        winners[_k + i] = i;
+    }
+    for (int node = _k - 1; node >= 1; node--) {
+        int winner = winners[2 * node];
+        int loser = winners[2 * node + 1];
+        if (_keys[loser] < _keys[winner]) {
+            swap(winner, loser);
+        }
+        winners[node] = winner;
+        _tree[node] = loser;
+    }
+    if (_k > 0) {
+        _tree[0] = winners[1];
+    }
+    _advancePending = false;
+}
+
+LoserTreeMerge::~LoserTreeMerge() {}
+
+/*
+ * The record handed out last is still in its reader's buffer, so its
+ * stream only moves on at the start of the next call.
+ */
+bool LoserTreeMerge::next(DataPointView& out) {
+    if (_k == 0) return false;
+    if (_advancePending) {
+        advance(_tree[0]);
+        replay(_tree[0]);
+        _advancePending = false;
+    }
+    int winner = _tree[0];
+    if (_keys[winner] == kExhausted) return false;
+    out = _heads[winner];
+    _advancePending = true;
+    return true;
+}
+
+bool LoserTreeMerge::next(DataPoint& out) {
+    DataPointView view;
+    if (!next(view)) return false;
+    out.label.assign(view.label.data(), view.label.size());
+    out.priority = view.priority;
+    return true;
+}
+
+bool LoserTreeMerge::failed() const {
+    for (const auto& reader : _readers) {
+        if (reader->failed()) return true;
+    }
+    return false;
+}
+
+int LoserTreeMerge::numStreams() const {
+    return _k;
+}
+
+/*
+ * Reads the next head of the stream. Its key can't be smaller than the
+ * last one, which is how an unsorted stream is caught.
+ */
+void LoserTreeMerge::advance(int stream) {
+    if (!_readers[stream]->next(_heads[stream])) {
+        _keys[stream] = kExhausted;
+        return;
+    }
+    uint64_t key = keyOf(_heads[stream].priority, stream);
+    if (key < _keys[stream]) {
+        error("Stream " + integerToString(stream) + " is not sorted by priority");
+    }
+    _keys[stream] = key;
+}
+
+/*
+ * Plays the stream's new head up the path to the root. At each node the
+ * loser stored there meets the winner coming up; whichever loses stays.
+ */
+void LoserTreeMerge::replay(int stream) {
+    int winner = stream;
+    for (int node = (stream + _k) >> 1; node > 0; node >>= 1) {
+        if (_keys[_tree[node]] < _keys[winner]) {
+            swap(_tree[node], winner);
+        }
+    }
+    _tree[0] = winner;
+}
+
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+/* Writes each run to its own stream, one record per line as mergeSorted does. */
+static Vector<stringstream*> toStreams(const Vector<Vector<DataPoint>>& runs) {
+    Vector<stringstream*> streams;
+    for (const Vector<DataPoint>& run : runs) {
+        stringstream* stream = new stringstream;
+        for (const DataPoint& pt : run) {
+            *stream << pt << "\n";
+        }
+        streams.add(stream);
+    }
+    return streams;
+}
+
+static Vector<istream*> asInputs(const Vector<stringstream*>& streams) {
+    Vector<istream*> inputs;
+    for (stringstream* stream : streams) {
+        inputs.add(stream);
+    }
+    return inputs;
+}
+
+static Vector<DataPoint> mergeAll(LoserTreeMerge& merge) {
+    Vector<DataPoint> result;
+    DataPoint pt;
+    while (merge.next(pt)) {
+        result.add(pt);
+    }
+    return result;
+}
+
+STUDENT_TEST("LoserTreeMerge matches a stable sort of every run put together") {
+    for (int k : { 0, 1, 2, 3, 7, 8, 64, 100 }) {
+        Vector<Vector<DataPoint>> runs;
+        Vector<DataPoint> expected;
+        for (int i = 0; i < k; i++) {
+            // a few empty runs, and lots of ties within and across runs
+            int length = randomChance(0.2) ? 0 : randomInteger(1, 50);
+            Vector<DataPoint> run;
+            for (int j = 0; j < length; j++) {
+                run.add({ integerToString(i) + "." + integerToString(j), randomInteger(-20, 20) });
+            }
+            stable_sort(run.begin(), run.end(), [](const DataPoint& a, const DataPoint& b) {
+                return a.priority < b.priority;
+            });
+            runs.add(run);
+            for (const DataPoint& pt : run) {
+                expected.add(pt);
+            }
+        }
+        stable_sort(expected.begin(), expected.end(), [](const DataPoint& a, const DataPoint& b) {
+            return a.priority < b.priority;
+        });
+
+        Vector<stringstream*> streams = toStreams(runs);
+        LoserTreeMerge merge(asInputs(streams), 16);
+        EXPECT_EQUAL(merge.numStreams(), k);
+        EXPECT_EQUAL(mergeAll(merge), expected);
+        EXPECT(!merge.failed());
+        DataPointView view;
+        EXPECT(!merge.next(view));
+        for (stringstream* stream : streams) {
+            delete stream;
+        }
+    }
+}
+
+STUDENT_TEST("LoserTreeMerge handles extreme priorities, bad input and unsorted runs") {
+    Vector<Vector<DataPoint>> runs = { { { "min", INT_MIN }, { "max", INT_MAX } },
+                                       { { "zero", 0 }, { "max too", INT_MAX } } };
+    Vector<stringstream*> streams = toStreams(runs);
+    LoserTreeMerge merge(asInputs(streams));
+    Vector<DataPoint> expected = { { "min", INT_MIN }, { "zero", 0 }, { "max", INT_MAX }, { "max too", INT_MAX } };
+    EXPECT_EQUAL(mergeAll(merge), expected);
+    for (stringstream* stream : streams) {
+        delete stream;
+    }
+
+    stringstream good("{ \"a\", 1 } { \"c\", 3 }");
+    stringstream bad("{ \"b\", 2 } junk");
+    LoserTreeMerge malformed({ &good, &bad });
+    Vector<DataPoint> partial = { { "a", 1 }, { "b", 2 }, { "c", 3 } };
+    EXPECT_EQUAL(mergeAll(malformed), partial);
+    EXPECT(malformed.failed());
+
+    stringstream sorted("{ \"a\", 1 } { \"b\", 5 }");
+    stringstream unsorted("{ \"x\", 2 } { \"y\", 1 }");
+    LoserTreeMerge backward({ &sorted, &unsorted });
+    DataPoint pt;
+    EXPECT(backward.next(pt));
+    EXPECT(backward.next(pt));
+    EXPECT_ERROR(backward.next(pt));
+
+    EXPECT_ERROR(LoserTreeMerge({ &good, nullptr }));
+}
+
+/* The merge without a loser tree: the full DataPoint at the head of each
+ * stream goes through an indexed binary heap, whose handles say which
+ * stream to refill from. Returns the sum of the priorities.
+ */
+static long long heapMerge(const Vector<istream*>& streams) {
+    vector<unique_ptr<DataPointReader>> readers;
+    PQIndexedHeap heap;
+    Vector<int> streamOf;
+    for (int i = 0; i < streams.size(); i++) {
+        readers.push_back(make_unique<DataPointReader>(*streams[i], -1, LoserTreeMerge::kDefaultBlockSize));
+        DataPoint pt;
+        if (readers[i]->next(pt)) {
+            int handle = heap.enqueue(std::move(pt));
+            while (streamOf.size() <= handle) streamOf.add(-1);
+            streamOf[handle] = i;
+        }
+    }
+    long long sum = 0;
+    DataPoint pt;
+    while (!heap.isEmpty()) {
+        int stream = streamOf[heap.peekHandle()];
+        pt = heap.dequeue();
+        sum += pt.priority;
+        if (readers[stream]->next(pt)) {
+            int handle = heap.enqueue(std::move(pt));
+            while (streamOf.size() <= handle) streamOf.add(-1);
+            streamOf[handle] = stream;
+        }
+    }
+    return sum;
+}
+
+static long long loserTreeMerge(const Vector<istream*>& streams) {
+    LoserTreeMerge merge(streams);
+    long long sum = 0;
+    DataPointView view;
+    while (merge.next(view)) {
+        sum += view.priority;
+    }
+    return sum;
+}
+
+/* Puts every stream back at its start, so the same input can be merged again. */
+static const Vector<istream*>& rewound(const Vector<istream*>& streams) {
+    for (istream* stream : streams) {
+        stream->clear();
+        stream->seekg(0);
+    }
+    return streams;
+}
+
+STUDENT_TEST("LoserTreeMerge time trial versus an indexed heap, 1M records over k = 2 to 1024 streams") {
+    int numRecords = 1000000;
+    for (int k = 2; k <= 1024; k *= 2) {
+        Vector<Vector<DataPoint>> runs(k);
+        for (int i = 0; i < numRecords; i++) {
+            runs[randomInteger(0, k - 1)].add({ "label" + integerToString(i % 1000), randomInteger(0, 1 << 30) });
+        }
+        for (Vector<DataPoint>& run : runs) {
+            sort(run.begin(), run.end(), [](const DataPoint& a, const DataPoint& b) {
+                return a.priority < b.priority;
+            });
+        }
+        Vector<stringstream*> streams = toStreams(runs);
+        Vector<istream*> inputs = asInputs(streams);
+
+        long long expected = heapMerge(rewound(inputs));
+        EXPECT_EQUAL(loserTreeMerge(rewound(inputs)), expected);
+        TIME_OPERATION(k, heapMerge(rewound(inputs)));
+        TIME_OPERATION(k, loserTreeMerge(rewound(inputs)));
+        for (stringstream* stream : streams) {
+            delete stream;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "datapoint.h"
+#include "datapointreader.h"
+#include "vector.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <vector>
+
+/**
+ * Merges k streams of DataPoints, each already sorted by increasing
+ * priority, such as the per-shard outputs of pqSort, into one sorted
+ * sequence that is read a record at a time.
+ *
+ * The heads of the streams sit at the leaves of a tournament tree. Each
+ * internal node remembers the loser of the match played there, and the
+ * overall winner is kept above the root. Once the winner has been handed
+ * out, only its own stream has a new head, so only the matches on the
+ * path from its leaf to the root are replayed, against the losers stored
+ * along it: one comparison per level, ceil(log2 k) in all, where a binary
+ * heap needs two per level on the way down. A priority and a stream index
+ * are packed into one 64-bit key, so each comparison is a single integer
+ * compare, and an exhausted stream gets a key larger than any record.
+ *
+ * Each stream is read by its own DataPointReader, and heads are label
+ * views into the readers' buffers, so records are not copied on their
+ * way through the tree.
+ *
+ * The merge is stable: of records with equal priority, those from a
+ * stream earlier in the list come first, and those from the same stream
+ * keep their order.
+ */
+class LoserTreeMerge {
+public:
+    /**
+     * Size of the blocks each stream is read in unless another is given.
+     */
+    static constexpr size_t kDefaultBlockSize = 1 << 16;
+
+    /**
+     * Creates a merge of the given streams, reading the first record of
+     * each. The streams must outlive the merge.
+     *
+     * If a stream is null, this function calls error().
+     */
+    LoserTreeMerge(const Vector<std::istream*>& streams, size_t blockSize = kDefaultBlockSize);
+
+    /**
+     * Cleans up the readers.
+     */
+    ~LoserTreeMerge();
+
+    /**
+     * Reads the next record of the merged sequence. Returns false once
+     * every stream has ended, or has stopped at malformed input. The view
+     * version doesn't copy the label, and the view is only valid until the
+     * next call.
+     *
+     * If a stream turns out not to be sorted, this function calls error().
+     */
+    bool next(DataPointView& out);
+    bool next(DataPoint& out);
+
+    /**
+     * Returns whether any stream stopped at malformed input rather than at
+     * the end after a whole number of records.
+     */
+    bool failed() const;
+
+    /**
+     * Returns the number of streams being merged.
+     */
+    int numStreams() const;
+
+private:
+    int _k;                         // number of streams
+    std::vector<std::unique_ptr<DataPointReader>> _readers;
+    std::vector<DataPointView> _heads;  // current record of each stream
+    std::vector<uint64_t> _keys;    // priority and index of each head, or kExhausted
+    std::vector<int> _tree;         // _tree[0] is the winner, _tree[1.._k-1] the losers
+    bool _advancePending;           // the winner was handed out and its stream must move on
+
+    void advance(int stream);
+    void replay(int stream);
+
+    /* Weird C++isms: You're not allowed to copy or assign merges. */
+    LoserTreeMerge(const LoserTreeMerge &) = delete;
+    void operator=(const LoserTreeMerge &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(LoserTreeMerge);
+};
@@ -0,0 +1,104 @@
+/* Element storage for the priority queues through std::pmr memory
+ * resources, and a monotonic arena for queues that live for one request.
+ */
+#include "pqarena.h"
+#include "pqheap.h"
+#include "pqsortedarray.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include "testing/SimpleTest.h"
+using namespace std;
+
+DataPoint* allocateElements(pmr::memory_resource* resource, int n) {
+    DataPoint* elements = (DataPoint*) resource->allocate(n * sizeof(DataPoint), alignof(DataPoint));
+    uninitialized_default_construct_n(elements, n);
+    return elements;
+}
+
+void freeElements(pmr::memory_resource* resource, DataPoint* elements, int n) {
+    destroy_n(elements, n);
+    resource->deallocate(elements, n * sizeof(DataPoint), alignof(DataPoint));
+}
+
+/*
+ * The monotonic resource works out of the block first, and only goes to
+ * the default resource once the block is used up.
+ */
+PQArena::PQArena(size_t blockBytes)
+    : _block(new char[blockBytes]), _resource(_block.get(), blockBytes) {}
+
+pmr::memory_resource* PQArena::resource() {
+    return &_resource;
+}
+
+void PQArena::release() {
+    _resource.release();
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("Queues in an arena work like queues on the heap, and make no allocations") {
+    PQArena arena;
+    for (int round = 0; round < 3; round++) {
+        long before = numHeapAllocations();
+        {
+            PQHeap heap(arena.resource());
+            PQSortedArray sorted(arena.resource());
+            for (int i = 0; i < 200; i++) {
+                int priority = randomInteger(0, 1000);
+                heap.enqueue({ "", priority });
+                sorted.enqueue({ "", priority });
+            }
+            heap.validateInternalState();
+            sorted.validateInternalState();
+            while (!heap.isEmpty()) {
+                EXPECT_EQUAL(heap.dequeue().priority, sorted.dequeue().priority);
+            }
+        }
+        EXPECT_EQUAL(numHeapAllocations() - before, 0);
+        arena.release();
+    }
+
+    // a queue that outgrows the block falls back to the default resource
+    PQArena small(256);
+    PQHeap heap(small.resource());
+    for (int i = 0; i < 1000; i++) {
+        heap.enqueue({ "", i });
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQUAL(heap.dequeue().priority, i);
+    }
+}
+
+/* One request's worth of work: a queue is created, filled, drained and
+ * destroyed, and the arena (if any) is then released.
+ */
+template <typename PQueue>
+static void requestCycles(int numRequests, int numElements, PQArena* arena) {
+    for (int r = 0; r < numRequests; r++) {
+        {
+            PQueue pq(arena ? arena->resource() : pmr::get_default_resource());
+            for (int i = 0; i < numElements; i++) {
+                pq.enqueue({ "", (i * 7919) % numElements });
+            }
+            while (!pq.isEmpty()) {
+                pq.dequeue();
+            }
+        }
+        if (arena) arena->release();
+    }
+}
+
+STUDENT_TEST("Timing test, create/fill/drain/destroy with new[] and with an arena") {
+    int numRequests = 100000;
+    PQArena arena;
+    for (int numElements = 8; numElements <= 128; numElements *= 4) {
+        TIME_OPERATION(numElements, requestCycles<PQHeap>(numRequests, numElements, nullptr));
+        TIME_OPERATION(numElements, requestCycles<PQHeap>(numRequests, numElements, &arena));
+        TIME_OPERATION(numElements, requestCycles<PQSortedArray>(numRequests, numElements, nullptr));
+        TIME_OPERATION(numElements, requestCycles<PQSortedArray>(numRequests, numElements, &arena));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "datapoint.h"
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+/**
+ * Allocates an array of n default-constructed DataPoints from the given
+ * memory resource. The priority queues take their element arrays from
+ * here rather than from new[], so that the caller can choose where they
+ * come from.
+ */
+DataPoint* allocateElements(std::pmr::memory_resource* resource, int n);
+
+/**
+ * Destroys the n DataPoints of an array from allocateElements and hands
+ * its memory back to the resource it came from.
+ */
+void freeElements(std::pmr::memory_resource* resource, DataPoint* elements, int n);
+
+/**
+ * A monotonic arena for short-lived priority queues, such as the ones made
+ * and thrown away for each request a server handles.
+ *
+ * Queues created with arena.resource() carve their arrays out of one block
+ * that the arena allocates up front, by bumping a pointer. Freeing an array
+ * does nothing, and release() takes back all of the memory at once, so a
+ * create/fill/drain/destroy cycle that fits in the block makes no calls to
+ * the global allocator at all. Arrays that grow leave their old copies
+ * behind until release(), so a queue can use up to twice the memory it
+ * would with new[]. If the block runs out, more is taken from the default
+ * resource until the next release().
+ *
+ * The labels of the DataPoints still use the global allocator; an arena
+ * only holds the element arrays.
+ */
+class PQArena {
+public:
+    /**
+     * Creates an arena with an initial block of the given size.
+     */
+    PQArena(size_t blockBytes = 64 * 1024);
+
+    /**
+     * Returns the memory resource to create queues with.
+     */
+    std::pmr::memory_resource* resource();
+
+    /**
+     * Frees everything allocated from the arena since the last release()
+     * and starts over at the beginning of the block. All of the queues
+     * created with the arena must already be destroyed.
+     */
+    void release();
+
+private:
+    std::unique_ptr<char[]> _block;
+    std::pmr::monotonic_buffer_resource _resource;
+
+    /* Weird C++isms: You're not allowed to copy or assign arenas. */
+    PQArena(const PQArena &) = delete;
+    void operator=(const PQArena &) = delete;
+};
@@ -0,0 +1,360 @@
+/* The benchmark suite: input generators, the repetition runner, the
+ * workloads, and the CSV and JSON writers.
+ */
+#include "pqbenchmark.h"
+#include "pqclient.h"
+#include "pqheap.h"
+#include "pqsortedarray.h"
+#include "error.h"
+#include "strlib.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+/* Written to at the end of every run so the compiler can't drop the work. */
+static volatile long long benchmarkSink;
+
+string distributionName(Distribution dist) {
+    switch (dist) {
+        case Distribution::Sorted:     return "sorted";
+        case Distribution::Reverse:    return "reverse";
+        case Distribution::Random:     return "random";
+        case Distribution::Duplicates: return "duplicates";
+        case Distribution::Sawtooth:   return "sawtooth";
+    }
+    error("Unknown distribution");
+    return "";
+}
+
+static Distribution distributionNamed(const string& name) {
+    for (Distribution dist : { Distribution::Sorted, Distribution::Reverse, Distribution::Random,
+                               Distribution::Duplicates, Distribution::Sawtooth }) {
+        if (distributionName(dist) == name) return dist;
+    }
+    error("Unknown distribution: " + name);
+    return Distribution::Random;
+}
+
+Vector<DataPoint> makeBenchmarkInput(Distribution dist, int n, unsigned seed) {
+    mt19937 generator(seed);
+    Vector<DataPoint> points;
+    for (int i = 0; i < n; i++) {
+        int priority = 0;
+        switch (dist) {
+            case Distribution::Sorted:     priority = i; break;
+            case Distribution::Reverse:    priority = n - i; break;
+            case Distribution::Random:     priority = uniform_int_distribution<int>(0, n)(generator); break;
+            case Distribution::Duplicates: priority = uniform_int_distribution<int>(0, 15)(generator); break;
+            case Distribution::Sawtooth:   priority = i % 1000; break;
+        }
+        points.add({ "point" + integerToString(i % 1000), priority });
+    }
+    return points;
+}
+
+/* Seconds since start. */
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Returns the value at the given fraction of the way through the sorted samples. */
+static double percentile(const vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    int index = (int) ceil(fraction * sorted.size()) - 1;
+    return sorted[max(0, min(index, (int) sorted.size() - 1))];
+}
+
+/* Fills in the latency fields from unsorted per-operation samples, in nanoseconds. */
+static void summarizeLatency(vector<double>& nanos, BenchmarkResult& result) {
+    sort(nanos.begin(), nanos.end());
+    result.p50Nanos = percentile(nanos, 0.50);
+    result.p90Nanos = percentile(nanos, 0.90);
+    result.p99Nanos = percentile(nanos, 0.99);
+    result.maxNanos = nanos.empty() ? 0 : nanos.back();
+}
+
+/*
+ * Runs the case the given number of times after the warmups and fills in
+ * the seconds fields of the result. prepare is called before every run,
+ * untimed, and run is the part that is timed.
+ */
+static void timeRepetitions(const BenchmarkOptions& options,
+                            const function<void()>& prepare,
+                            const function<void()>& run,
+                            BenchmarkResult& result) {
+    for (int i = 0; i < options.warmups; i++) {
+        prepare();
+        run();
+    }
+    vector<double> seconds;
+    for (int i = 0; i < options.repetitions; i++) {
+        prepare();
+        Clock::time_point start = Clock::now();
+        run();
+        seconds.push_back(secondsSince(start));
+    }
+    sort(seconds.begin(), seconds.end());
+
+    double total = 0;
+    for (double s : seconds) total += s;
+    double mean = total / seconds.size();
+    double squares = 0;
+    for (double s : seconds) squares += (s - mean) * (s - mean);
+
+    result.repetitions = seconds.size();
+    result.minSeconds = seconds.front();
+    result.medianSeconds = percentile(seconds, 0.50);
+    result.meanSeconds = mean;
+    result.maxSeconds = seconds.back();
+    result.stddevSeconds = sqrt(squares / seconds.size());
+    result.throughput = result.medianSeconds > 0 ? result.size / result.medianSeconds : 0;
+}
+
+/*
+ * Measures a queue type: every run enqueues the whole input and then
+ * dequeues all of it. The extra latency run times each operation alone.
+ */
+template <typename PQueue>
+static void benchmarkQueue(const BenchmarkOptions& options, const Vector<DataPoint>& input,
+                           BenchmarkResult& result) {
+    Vector<DataPoint> batch;
+    auto prepare = [&]() { batch = input; };
+    auto run = [&]() {
+        PQueue pq;
+        for (DataPoint& point : batch) {
+            pq.enqueue(std::move(point));
+        }
+        long long total = 0;
+        while (!pq.isEmpty()) {
+            total += pq.dequeue().priority;
+        }
+        benchmarkSink = total;
+    };
+    timeRepetitions(options, prepare, run, result);
+
+    prepare();
+    vector<double> nanos;
+    nanos.reserve(2 * (size_t) batch.size());
+    PQueue pq;
+    for (DataPoint& point : batch) {
+        Clock::time_point start = Clock::now();
+        pq.enqueue(std::move(point));
+        nanos.push_back(chrono::duration<double, nano>(Clock::now() - start).count());
+    }
+    long long total = 0;
+    while (!pq.isEmpty()) {
+        Clock::time_point start = Clock::now();
+        total += pq.dequeue().priority;
+        nanos.push_back(chrono::duration<double, nano>(Clock::now() - start).count());
+    }
+    benchmarkSink = total;
+    summarizeLatency(nanos, result);
+}
+
+/*
+ * Fills in the latency fields of a single-call workload from the times of
+ * its runs, leaving out the warmups at the front.
+ */
+static void latencyFromRuns(vector<double> seconds, int warmups, BenchmarkResult& result) {
+    vector<double> nanos;
+    for (int i = warmups; i < (int) seconds.size(); i++) {
+        nanos.push_back(seconds[i] * 1e9 / max(1, result.size));
+    }
+    summarizeLatency(nanos, result);
+}
+
+static void benchmarkPQSort(const BenchmarkOptions& options, const Vector<DataPoint>& input,
+                            BenchmarkResult& result) {
+    Vector<DataPoint> v;
+    vector<double> seconds;
+    auto prepare = [&]() { v = input; };
+    auto run = [&]() {
+        Clock::time_point start = Clock::now();
+        pqSort(v);
+        seconds.push_back(secondsSince(start));
+        benchmarkSink = v.isEmpty() ? 0 : v[0].priority;
+    };
+    timeRepetitions(options, prepare, run, result);
+
+    latencyFromRuns(seconds, options.warmups, result);
+}
+
+static void benchmarkTopK(const BenchmarkOptions& options, const Vector<DataPoint>& input,
+                          BenchmarkResult& result) {
+    ostringstream text;
+    for (const DataPoint& point : input) {
+        text << point << " ";
+    }
+    string contents = text.str();
+
+    istringstream stream;
+    vector<double> seconds;
+    auto prepare = [&]() { stream.clear(); stream.str(contents); };
+    auto run = [&]() {
+        Clock::time_point start = Clock::now();
+        Vector<DataPoint> best = topK(stream, options.topKSize);
+        seconds.push_back(secondsSince(start));
+        benchmarkSink = best.size();
+    };
+    timeRepetitions(options, prepare, run, result);
+
+    latencyFromRuns(seconds, options.warmups, result);
+}
+
+Vector<BenchmarkResult> runBenchmarks(const BenchmarkOptions& options, ostream* progress) {
+    if (options.repetitions < 1) {
+        error("The benchmark needs at least one repetition");
+    }
+    for (const string& workload : options.workloads) {
+        if (workload != "PQHeap" && workload != "PQSortedArray" &&
+            workload != "pqSort" && workload != "topK") {
+            error("Unknown workload: " + workload);
+        }
+    }
+
+    Vector<BenchmarkResult> results;
+    for (int size : options.sizes) {
+        for (Distribution dist : options.distributions) {
+            Vector<DataPoint> input = makeBenchmarkInput(dist, size);
+            for (const string& workload : options.workloads) {
+                if (workload == "PQSortedArray" && size > options.maxQuadraticSize) continue;
+
+                BenchmarkResult result = {};
+                result.workload = workload;
+                result.distribution = distributionName(dist);
+                result.size = size;
+                if (workload == "PQHeap") {
+                    benchmarkQueue<PQHeap>(options, input, result);
+                } else if (workload == "PQSortedArray") {
+                    benchmarkQueue<PQSortedArray>(options, input, result);
+                } else if (workload == "pqSort") {
+                    benchmarkPQSort(options, input, result);
+                } else {
+                    benchmarkTopK(options, input, result);
+                }
+                results.add(result);
+
+                if (progress != nullptr) {
+                    *progress << workload << " " << result.distribution << " size=" << size
+                              << " median=" << result.medianSeconds << "s"
+                              << " throughput=" << result.throughput << "/s" << endl;
+                }
+            }
+        }
+    }
+    return results;
+}
+
+/* Formats a measurement with enough digits for a spreadsheet and no more. */
+static string formatNumber(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof buffer, "%.6g", value);
+    return buffer;
+}
+
+void writeBenchmarkCsv(const Vector<BenchmarkResult>& results, ostream& out) {
+    out << "workload,distribution,size,repetitions,min_s,median_s,mean_s,max_s,stddev_s,"
+           "throughput_per_s,p50_ns,p90_ns,p99_ns,max_ns" << endl;
+    for (const BenchmarkResult& r : results) {
+        out << r.workload << "," << r.distribution << "," << r.size << "," << r.repetitions << ","
+            << formatNumber(r.minSeconds) << "," << formatNumber(r.medianSeconds) << ","
+            << formatNumber(r.meanSeconds) << "," << formatNumber(r.maxSeconds) << ","
+            << formatNumber(r.stddevSeconds) << "," << formatNumber(r.throughput) << ","
+            << formatNumber(r.p50Nanos) << "," << formatNumber(r.p90Nanos) << ","
+            << formatNumber(r.p99Nanos) << "," << formatNumber(r.maxNanos) << endl;
+    }
+}
+
+void writeBenchmarkJson(const Vector<BenchmarkResult>& results, ostream& out) {
+    out << "[";
+    for (int i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "  {\"workload\": \"" << r.workload << "\""
+            << ", \"distribution\": \"" << r.distribution << "\""
+            << ", \"size\": " << r.size
+            << ", \"repetitions\": " << r.repetitions
+            << ", \"min_s\": " << formatNumber(r.minSeconds)
+            << ", \"median_s\": " << formatNumber(r.medianSeconds)
+            << ", \"mean_s\": " << formatNumber(r.meanSeconds)
+            << ", \"max_s\": " << formatNumber(r.maxSeconds)
+            << ", \"stddev_s\": " << formatNumber(r.stddevSeconds)
+            << ", \"throughput_per_s\": " << formatNumber(r.throughput)
+            << ", \"p50_ns\": " << formatNumber(r.p50Nanos)
+            << ", \"p90_ns\": " << formatNumber(r.p90Nanos)
+            << ", \"p99_ns\": " << formatNumber(r.p99Nanos)
+            << ", \"max_ns\": " << formatNumber(r.maxNanos) << "}";
+    }
+    out << "\n]" << endl;
+}
+
+int benchmarkMain(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    string csvPath, jsonPath;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string flag = argv[i];
+            if (i + 1 >= argc) {
+                error("Missing value after " + flag);
+            }
+            string value = argv[++i];
+            if (flag == "--sizes") {
+                options.sizes.clear();
+                for (const string& size : stringSplit(value, ",")) {
+                    options.sizes.add(stringToInteger(size));
+                }
+            } else if (flag == "--distributions") {
+                options.distributions.clear();
+                for (const string& name : stringSplit(value, ",")) {
+                    options.distributions.add(distributionNamed(name));
+                }
+            } else if (flag == "--workloads") {
+                options.workloads = stringSplit(value, ",");
+            } else if (flag == "--warmups") {
+                options.warmups = stringToInteger(value);
+            } else if (flag == "--repetitions") {
+                options.repetitions = stringToInteger(value);
+            } else if (flag == "--max-quadratic") {
+                options.maxQuadraticSize = stringToInteger(value);
+            } else if (flag == "--csv") {
+                csvPath = value;
+            } else if (flag == "--json") {
+                jsonPath = value;
+            } else {
+                error("Unknown option: " + flag);
+            }
+        }
+
+        Vector<BenchmarkResult> results = runBenchmarks(options, &cerr);
+        if (csvPath.empty() && jsonPath.empty()) {
+            writeBenchmarkCsv(results, cout);
+        }
+        if (!csvPath.empty()) {
+            ofstream out(csvPath);
+            writeBenchmarkCsv(results, out);
+        }
+        if (!jsonPath.empty()) {
+            ofstream out(jsonPath);
+            writeBenchmarkJson(results, out);
+        }
+    } catch (const ErrorException& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef PQ_BENCHMARK_MAIN
+int main(int argc, char* argv[]) {
+    return benchmarkMain(argc, argv);
+}
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include <iostream>
+#include <string>
+
+/**
+ * The priority distributions the benchmark suite feeds to each workload.
+ * Sorted and Reverse are the best and worst case for the sorted array,
+ * Duplicates draws from only 16 distinct priorities, and Sawtooth is a
+ * run of 1000 increasing priorities repeated over and over.
+ */
+enum class Distribution { Sorted, Reverse, Random, Duplicates, Sawtooth };
+
+/**
+ * Returns the name of the distribution as it appears in the output,
+ * such as "random".
+ */
+std::string distributionName(Distribution dist);
+
+/**
+ * Returns n DataPoints whose priorities follow the given distribution.
+ * The same seed always gives the same points, so two runs of the suite
+ * measure the same input.
+ */
+Vector<DataPoint> makeBenchmarkInput(Distribution dist, int n, unsigned seed = 106);
+
+/**
+ * Settings for one run of the suite. Every workload is run on every
+ * distribution at every size, except that the workloads that take
+ * quadratic time skip the sizes above maxQuadraticSize.
+ */
+struct BenchmarkOptions {
+    Vector<int> sizes = { 1000, 10000, 100000, 1000000, 10000000 };
+    Vector<Distribution> distributions = { Distribution::Sorted, Distribution::Reverse,
+                                           Distribution::Random, Distribution::Duplicates,
+                                           Distribution::Sawtooth };
+    Vector<std::string> workloads = { "PQHeap", "PQSortedArray", "pqSort", "topK" };
+    int warmups = 1;                // untimed runs before the timed ones
+    int repetitions = 5;            // timed runs per case
+    int maxQuadraticSize = 10000;   // largest size given to PQSortedArray
+    int topKSize = 1000;            // k for the topK workload
+};
+
+/**
+ * The measurements for one workload on one distribution at one size.
+ *
+ * The seconds fields summarize the wall time of the timed repetitions,
+ * and throughput is size divided by the median of them.
+ *
+ * The latency fields are percentiles of the time taken by a single
+ * operation, in nanoseconds. For the queues, each enqueue and dequeue
+ * is timed on its own in one extra run, which is kept apart from the
+ * repetitions so the clock reads don't slow those down. pqSort and topK
+ * are single calls, so for them the percentiles are taken over the
+ * repetitions and divided by the size.
+ */
+struct BenchmarkResult {
+    std::string workload;
+    std::string distribution;
+    int size;
+    int repetitions;
+    double minSeconds;
+    double medianSeconds;
+    double meanSeconds;
+    double maxSeconds;
+    double stddevSeconds;
+    double throughput;      // elements per second
+    double p50Nanos;
+    double p90Nanos;
+    double p99Nanos;
+    double maxNanos;
+};
+
+/**
+ * Runs every case in the options and returns one result per case, in
+ * the order they ran. If progress is not null, a line is written to it
+ * as each case finishes. Calls error() if the options name a workload
+ * that doesn't exist or ask for no repetitions.
+ */
+Vector<BenchmarkResult> runBenchmarks(const BenchmarkOptions& options,
+                                      std::ostream* progress = nullptr);
+
+/**
+ * Writes the results as CSV, one header line and then one line per result.
+ */
+void writeBenchmarkCsv(const Vector<BenchmarkResult>& results, std::ostream& out);
+
+/**
+ * Writes the results as a JSON array with one object per result.
+ */
+void writeBenchmarkJson(const Vector<BenchmarkResult>& results, std::ostream& out);
+
+/**
+ * The entry point of the standalone benchmark program. The program is
+ * built from the same sources as the tests, but with PQ_BENCHMARK_MAIN
+ * defined and without the file that holds the test driver's main, so
+ * that the main at the end of pqbenchmark.cpp takes its place. The other
+ * sources still register their tests with SimpleTest, so the course
+ * library is linked as usual, but none of those tests run. This repo has
+ * no build rule for the program; it has to be set up in the project by
+ * hand. It understands
+ *
+ *     --sizes 1000,10000       --distributions random,sorted
+ *     --workloads PQHeap,topK  --warmups 1  --repetitions 5
+ *     --max-quadratic 10000    --csv results.csv  --json results.json
+ *
+ * and prints a CSV table to cout if neither output file is given.
+ * Returns the exit status.
+ */
+int benchmarkMain(int argc, char* argv[]);
@@ -0,0 +1,74 @@
+/* Tests for the benchmark suite. They live apart from pqbenchmark.cpp,
+ * which holds only the suite and the benchmark program's main.
+ */
+#include "pqbenchmark.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+STUDENT_TEST("makeBenchmarkInput has the promised shapes and is repeatable") {
+    int n = 5000;
+    Vector<DataPoint> sorted = makeBenchmarkInput(Distribution::Sorted, n);
+    Vector<DataPoint> reverse = makeBenchmarkInput(Distribution::Reverse, n);
+    Vector<DataPoint> duplicates = makeBenchmarkInput(Distribution::Duplicates, n);
+    Vector<DataPoint> sawtooth = makeBenchmarkInput(Distribution::Sawtooth, n);
+    EXPECT_EQUAL(sorted.size(), n);
+    for (int i = 1; i < n; i++) {
+        EXPECT(sorted[i - 1].priority < sorted[i].priority);
+        EXPECT(reverse[i - 1].priority > reverse[i].priority);
+        EXPECT(duplicates[i].priority >= 0 && duplicates[i].priority < 16);
+        EXPECT_EQUAL(sawtooth[i].priority, i % 1000);
+    }
+    EXPECT_EQUAL(makeBenchmarkInput(Distribution::Random, n, 7),
+                 makeBenchmarkInput(Distribution::Random, n, 7));
+}
+
+STUDENT_TEST("runBenchmarks covers every case and writes CSV and JSON") {
+    BenchmarkOptions options;
+    options.sizes = { 100, 2000 };
+    options.distributions = { Distribution::Random, Distribution::Sawtooth };
+    options.warmups = 1;
+    options.repetitions = 3;
+    options.maxQuadraticSize = 1000;
+    options.topKSize = 10;
+    Vector<BenchmarkResult> results = runBenchmarks(options);
+
+    /* 4 workloads on each distribution at size 100, 3 at size 2000. */
+    EXPECT_EQUAL(results.size(), 2 * 4 + 2 * 3);
+    for (const BenchmarkResult& r : results) {
+        EXPECT_EQUAL(r.repetitions, 3);
+        EXPECT(r.minSeconds <= r.medianSeconds && r.medianSeconds <= r.maxSeconds);
+        EXPECT(r.p50Nanos <= r.p90Nanos && r.p90Nanos <= r.p99Nanos && r.p99Nanos <= r.maxNanos);
+        EXPECT(r.throughput > 0);
+    }
+
+    ostringstream csv;
+    writeBenchmarkCsv(results, csv);
+    string line;
+    istringstream lines(csv.str());
+    int numLines = 0;
+    while (getline(lines, line)) {
+        EXPECT_EQUAL(count(line.begin(), line.end(), ','), 13);
+        numLines++;
+    }
+    EXPECT_EQUAL(numLines, results.size() + 1);
+
+    ostringstream json;
+    writeBenchmarkJson(results, json);
+    string text = json.str();
+    EXPECT_EQUAL(text.front(), '[');
+    EXPECT_EQUAL(count(text.begin(), text.end(), '{'), results.size());
+    EXPECT_EQUAL(count(text.begin(), text.end(), '}'), results.size());
+}
+
+STUDENT_TEST("runBenchmarks rejects bad options") {
+    BenchmarkOptions options;
+    options.sizes = { 10 };
+    options.workloads = { "PQNothing" };
+    EXPECT_ERROR(runBenchmarks(options));
+    options.workloads = { "PQHeap" };
+    options.repetitions = 0;
+    EXPECT_ERROR(runBenchmarks(options));
+}
@@ -0,0 +1,257 @@
+/* A bucket queue for bounded integer priorities, with a two-level occupancy
+ * bitmap to find the front bucket.
+ */
+#include "pqbucket.h"
+#include "pqheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include <algorithm>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static const int INITIAL_CAPACITY = 10;
+static const long long kMaxBuckets = 1 << 24;
+
+PQBucket::PQBucket(int minPriority, int maxPriority) {
+    long long numBuckets = (long long) maxPriority - minPriority + 1;
+    if (numBuckets < 1 || numBuckets > kMaxBuckets)
+        error("PQBucket range must hold between 1 and 2^24 priorities");
+    _minPriority = minPriority;
+    _numBuckets = numBuckets;
+    _numWords = (_numBuckets + 63) / 64;
+    _numSummaryWords = (_numWords + 63) / 64;
+    _heads = new int[_numBuckets];
+    _tails = new int[_numBuckets];
+    _occupied = new uint64_t[_numWords];
+    _summary = new uint64_t[_numSummaryWords];
+    _numAllocated = INITIAL_CAPACITY;
+    _nodes = new Node[_numAllocated];
+    clear();
+}
+
+PQBucket::~PQBucket() {
+    delete[] _nodes;
+    delete[] _heads;
+    delete[] _tails;
+    delete[] _occupied;
+    delete[] _summary;
+}
+
+/*
+ * Links the element onto the tail of its bucket and sets the bucket's bit,
+ * and the summary bit for its word, in case the bucket was empty.
+ */
+void PQBucket::enqueue(DataPoint&& elem) {
+    long long bucket = (long long) elem.priority - _minPriority;
+    if (bucket < 0 || bucket >= _numBuckets)
+        error("Priority " + integerToString(elem.priority) + " is outside the range of this PQBucket");
+    int node = newNode();
+    _nodes[node].point = std::move(elem);
+    _nodes[node].next = -1;
+    if (_heads[bucket] == -1) {
+        _heads[bucket] = node;
+        _occupied[bucket / 64] |= uint64_t(1) << (bucket % 64);
+        _summary[bucket / 4096] |= uint64_t(1) << (bucket / 64 % 64);
+    } else {
+        _nodes[_tails[bucket]].next = node;
+    }
+    _tails[bucket] = node;
+    _numFilled++;
+}
+
+void PQBucket::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * Unlinks the head of the front bucket and clears the bits that no longer
+ * hold once that bucket is empty. The node goes onto the free list.
+ */
+DataPoint PQBucket::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    int bucket = firstBucket();
+    int node = _heads[bucket];
+    _heads[bucket] = _nodes[node].next;
+    if (_heads[bucket] == -1) {
+        _occupied[bucket / 64] &= ~(uint64_t(1) << (bucket % 64));
+        if (_occupied[bucket / 64] == 0) {
+            _summary[bucket / 4096] &= ~(uint64_t(1) << (bucket / 64 % 64));
+        }
+    }
+    _nodes[node].next = _freeList;
+    _freeList = node;
+    _numFilled--;
+    return std::move(_nodes[node].point);
+}
+
+DataPoint PQBucket::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _nodes[_heads[firstBucket()]].point;
+}
+
+int PQBucket::peekPriority() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _minPriority + firstBucket();
+}
+
+bool PQBucket::isEmpty() const {
+    return size() == 0;
+}
+
+int PQBucket::size() const {
+    return _numFilled;
+}
+
+/*
+ * Empties every bucket and both bitmaps. The nodes stay allocated and are
+ * handed out again from the start of the array.
+ */
+void PQBucket::clear() {
+    fill(_heads, _heads + _numBuckets, -1);
+    fill(_occupied, _occupied + _numWords, 0);
+    fill(_summary, _summary + _numSummaryWords, 0);
+    _numNodesUsed = 0;
+    _freeList = -1;
+    _numFilled = 0;
+}
+
+void PQBucket::validateInternalState() {
+    int numSeen = 0;
+    for (int bucket = 0; bucket < _numBuckets; bucket++) {
+        bool bitSet = (_occupied[bucket / 64] >> (bucket % 64)) & 1;
+        if (bitSet != (_heads[bucket] != -1))
+            error("Occupancy bit wrong for bucket " + integerToString(bucket));
+        for (int node = _heads[bucket]; node != -1; node = _nodes[node].next) {
+            if (_nodes[node].point.priority != _minPriority + bucket)
+                error("Element in wrong bucket " + integerToString(bucket));
+            if (_nodes[node].next == -1 && _tails[bucket] != node)
+                error("Tail wrong for bucket " + integerToString(bucket));
+            numSeen++;
+        }
+    }
+    for (int word = 0; word < _numWords; word++) {
+        bool bitSet = (_summary[word / 64] >> (word % 64)) & 1;
+        if (bitSet != (_occupied[word] != 0))
+            error("Summary bit wrong for word " + integerToString(word));
+    }
+    if (numSeen != _numFilled)
+        error("Buckets hold " + integerToString(numSeen) + " elements, not " + integerToString(_numFilled));
+}
+
+/*
+ * The first set bit of the first non-zero summary word names the first
+ * non-zero occupancy word, whose first set bit names the front bucket.
+ * Assumes the queue is not empty.
+ */
+int PQBucket::firstBucket() const {
+    int summaryWord = 0;
+    while (_summary[summaryWord] == 0) {
+        summaryWord++;
+    }
+    int word = summaryWord * 64 + __builtin_ctzll(_summary[summaryWord]);
+    return word * 64 + __builtin_ctzll(_occupied[word]);
+}
+
+/*
+ * Hands out a node from the free list, or else the next never used one.
+ */
+int PQBucket::newNode() {
+    if (_freeList != -1) {
+        int node = _freeList;
+        _freeList = _nodes[node].next;
+        return node;
+    }
+    ensureCapacity(_numNodesUsed + 1);
+    return _numNodesUsed++;
+}
+
+/* Makes sure the node array has room for numNeeded nodes, doubling its
+ * size and moving the nodes over. Links are indexes, so they stay valid.
+ */
+void PQBucket::ensureCapacity(int numNeeded) {
+    if (numNeeded <= _numAllocated)
+        return;
+    int newAllocated = max(_numAllocated * 2, numNeeded);
+    Node* newNodes = new Node[newAllocated];
+    for (int i = 0; i < _numNodesUsed; i++) {
+        newNodes[i] = std::move(_nodes[i]);
+    }
+    delete[] _nodes;
+    _nodes = newNodes;
+    _numAllocated = newAllocated;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQBucket example from writeup, validate each step") {
+    PQBucket pq(0, 10);
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    pq.validateInternalState();
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.size(), 9);
+    EXPECT_EQUAL(pq.peekPriority(), 1);
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+    EXPECT_ERROR(pq.enqueue({ "low", -1 }));
+    EXPECT_ERROR(pq.enqueue({ "high", 11 }));
+    EXPECT_ERROR(PQBucket(5, 4));
+}
+
+STUDENT_TEST("PQBucket matches PQHeap across a wide range and keeps ties in order") {
+    PQBucket pq(-5000, 20000);
+    PQHeap reference;
+    for (int i = 0; i < 5000; i++) {
+        DataPoint dp = { integerToString(i), randomInteger(-5000, 20000) };
+        pq.enqueue(dp);
+        reference.enqueue(dp);
+        if (i % 3 == 0) {
+            EXPECT_EQUAL(pq.dequeue().priority, reference.dequeue().priority);
+        }
+    }
+    pq.validateInternalState();
+    while (!reference.isEmpty()) {
+        EXPECT_EQUAL(pq.dequeue().priority, reference.dequeue().priority);
+    }
+
+    for (int i = 0; i < 10; i++) {
+        pq.enqueue({ integerToString(i), 7 });
+    }
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQUAL(pq.dequeue().label, integerToString(i));
+    }
+    pq.enqueue({ "left over", 3 });
+    pq.clear();
+    pq.validateInternalState();
+    EXPECT(pq.isEmpty());
+}
+
+STUDENT_TEST("PQBucket steady-state enqueue/dequeue cycle does no allocations") {
+    PQBucket pq(0, 4095);
+    for (int i = 0; i < 1000; i++) {
+        pq.enqueue({ "", randomInteger(0, 4095) });
+    }
+    long before = numHeapAllocations();
+    for (int i = 0; i < 10000; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority = randomInteger(0, 4095);
+        pq.enqueue(std::move(cur));
+    }
+    EXPECT_EQUAL(numHeapAllocations() - before, 0);
+    pq.validateInternalState();
+}
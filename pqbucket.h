@@ -0,0 +1,119 @@
+#pragma once
+
+#include "datapoint.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * Priority queue type implemented as a bucket queue, for priorities that
+ * fall in a small range declared up front.
+ *
+ * There is one bucket for each priority in the range, holding its elements
+ * in a linked list in the order they were enqueued. A bitmap with one bit
+ * per bucket records which buckets are occupied, and a second, smaller
+ * bitmap records which words of the first one are non-zero, so the front
+ * bucket is found with a couple of find-first-set instructions instead of
+ * comparisons between priorities. enqueue and dequeue take O(1) time plus
+ * a scan of R / 4096 summary words, where R is the size of the range.
+ */
+class PQBucket {
+public:
+    /**
+     * Creates a new, empty priority queue for priorities from minPriority
+     * to maxPriority, inclusive.
+     *
+     * If the range is empty or has more than 2^24 priorities, this
+     * function calls error().
+     */
+    PQBucket(int minPriority, int maxPriority);
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQBucket();
+
+    /**
+     * Adds a new element into the queue in O(1) time. Elements with equal
+     * priority are dequeued in the order they were enqueued.
+     *
+     * If the priority is outside the declared range, this function calls
+     * error().
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the priority of the frontmost element, without copying it.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekPriority() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Confirms that every element is in the bucket for its priority and
+     * that both bitmaps agree with the buckets, and calls error() if not.
+     */
+    void validateInternalState();
+
+private:
+    struct Node {
+        DataPoint point;
+        int next;           // next node in the same bucket, -1 at the end
+    };
+
+    Node* _nodes;           // dynamic array of list nodes
+    int _numAllocated;      // number of nodes allocated in array
+    int _numNodesUsed;      // nodes ever handed out, free or not
+    int _freeList;          // first free node, -1 if none
+    int _numFilled;         // number of elements in the queue
+
+    int _minPriority;
+    int _numBuckets;
+    int* _heads;            // first node of each bucket, -1 if empty
+    int* _tails;            // last node of each bucket
+    uint64_t* _occupied;    // bit b set if bucket b is non-empty
+    uint64_t* _summary;     // bit w set if _occupied[w] is non-zero
+    int _numWords;
+    int _numSummaryWords;
+
+    int firstBucket() const;
+    int newNode();
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQBucket(const PQBucket &) = delete;
+    void operator=(const PQBucket &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQBucket);
+};
@@ -4,60 +4,455 @@
 #include "pqclient.h"
 #include "pqsortedarray.h"
 #include "pqheap.h"
+#include "daryheap.h"
+#include "pqkeyheap.h"
+#include "topkaccumulator.h"
+#include "losertree.h"
+#include "datapointreader.h"
+#include "spscring.h"
 #include "vector.h"
 #include "strlib.h"
+#include "error.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
 #include "testing/SimpleTest.h"
 using namespace std;
 
-/* Using the Priority Queue data structure as a tool to sort, neat! */
+/* Below this size pqSort pushes the elements through a PQSortedArray, which is stable and quick for few elements.
+ * At this size and above, the four passes of the radix sort win.
+ */
+static const int kRadixSortThreshold = 256;
+
+/* Using the Priority Queue data structure as a tool to sort, neat! Small inputs go through a PQSortedArray, which
+ * dequeues equal priorities in the order they went in, and large ones through the radix sort, which is also stable.
+ */
 void pqSort(Vector<DataPoint>& v) {
-    PQSortedArray pq;
+    PQStats ignored;
+    pqSort(v, ignored);
+}
 
-    /* Add all the elements to the priority queue. */
-    for (int i = 0; i < v.size(); i++) {
-        pq.enqueue(v[i]);
+static void radixSort(Vector<DataPoint>& v, PQStats* stats);
+
+/* The small case is pqSort<PQSortedArray> written out, to get at the queue's stats. */
+void pqSort(Vector<DataPoint>& v, PQStats& stats) {
+    if (v.size() < kRadixSortThreshold) {
+        PQSortedArray pq;
+        for (int i = 0; i < v.size(); i++) {
+            pq.enqueue(std::move(v[i]));
+        }
+        for (int i = 0; i < v.size(); i++) {
+            v[i] = pq.dequeue();
+        }
+        stats += pq.stats();
+    } else {
+        radixSort(v, &stats);
     }
+}
+
+/* Moves the element at index down a max-heap of the first n elements of v until neither child is bigger. */
+static void bubbleDownMax(Vector<DataPoint>& v, int index, int n) {
+    while (2 * index + 1 < n) {
+        int child = 2 * index + 1;
+        if (child + 1 < n && v[child + 1].priority > v[child].priority) child++;
+        if (v[index].priority >= v[child].priority) break;
+        swap(v[index], v[child]);
+        index = child;
+    }
+}
 
-    /* Extract all the elements from the priority queue. Due
-     * to the priority queue property, we know that we will get
-     * these elements in sorted order, in order of increasing priority
-     * value. Store elements back into vector, now in sorted order.
-     */
-    for (int i = 0; i < v.size(); i++) {
-        v[i] = pq.dequeue();
+/* The vector is heapified bottom-up into a max-heap. Then the largest element is repeatedly swapped to the end of
+ * the heap, which shrinks by one, so the sorted part grows from the back of the vector.
+ */
+void pqHeapSort(Vector<DataPoint>& v) {
+    int n = v.size();
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        bubbleDownMax(v, i, n);
+    }
+    for (int end = n - 1; end > 0; end--) {
+        swap(v[0], v[end]);
+        bubbleDownMax(v, 0, end);
     }
 }
 
-/* This function constructs a vector with a fixed size of k, and enqueues these same datapoints. Then,
- * as we are going through the rest of the stream, we are constantly replacing the lowest values with the
- * higher cur's. In the end, we end up with the top k values in the correct sorted order.
+/* A priority, flipped so that unsigned order matches signed order, and the index of its element in the vector. */
+struct RadixKey {
+    uint32_t key;
+    int index;
+};
+
+/* The (key, index) pairs are sorted one byte at a time from the lowest byte up, with a counting pass for each byte.
+ * A pass where every key has the same byte is skipped. Each counting pass keeps the order of equal bytes, so the
+ * whole sort is stable. At the end the DataPoints are moved into place by following the cycles of the permutation,
+ * so each one moves about once and no buffer of DataPoints is needed.
+ */
+void pqRadixSort(Vector<DataPoint>& v) {
+    radixSort(v, nullptr);
+}
+
+/* The radix sort behind pqRadixSort, which adds its moves and buffers into stats if it isn't null. */
+static void radixSort(Vector<DataPoint>& v, PQStats* stats) {
+    int n = v.size();
+    vector<RadixKey> keys(n);
+    vector<RadixKey> scratch(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = { (uint32_t) v[i].priority ^ 0x80000000u, i };
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+        int counts[257] = {};
+        for (const RadixKey& k : keys) {
+            counts[((k.key >> shift) & 0xff) + 1]++;
+        }
+        if (n == 0 || counts[((keys[0].key >> shift) & 0xff) + 1] == n) continue;
+        for (int b = 0; b < 256; b++) {
+            counts[b + 1] += counts[b];
+        }
+        for (const RadixKey& k : keys) {
+            scratch[counts[(k.key >> shift) & 0xff]++] = k;
+        }
+        keys.swap(scratch);
+    }
+
+    // keys[i].index is now the element that belongs at position i
+    PQ_COUNT(long long moves = 0);
+    for (int start = 0; start < n; start++) {
+        if (keys[start].index == start) continue;
+        DataPoint displaced = std::move(v[start]);
+        int hole = start;
+        while (keys[hole].index != start) {
+            int from = keys[hole].index;
+            v[hole] = std::move(v[from]);
+            keys[hole].index = hole;
+            hole = from;
+            PQ_COUNT(moves++);
+        }
+        v[hole] = std::move(displaced);
+        keys[hole].index = hole;
+        PQ_COUNT(moves += 2);
+    }
+    if (stats != nullptr) {
+        PQ_COUNT(stats->moves += moves);
+        PQ_COUNT(stats->bytesAllocated += 2LL * n * sizeof(RadixKey));
+    }
+}
+
+/* A record of a mapped file to be sorted: its priority, and its index to break ties and find it again. */
+struct SortKey {
+    int priority;
+    int index;
+};
+
+/* Returns whether key a should come out of the heap before key b. */
+static bool comesBefore(const SortKey& a, const SortKey& b) {
+    return a.priority < b.priority || (a.priority == b.priority && a.index < b.index);
+}
+
+/* Moves the key at index down a min-heap of n keys until neither child should come out before it. */
+static void bubbleDownKey(Vector<SortKey>& heap, int index, int n) {
+    SortKey key = heap[index];
+    while (2 * index + 1 < n) {
+        int child = 2 * index + 1;
+        if (child + 1 < n && comesBefore(heap[child + 1], heap[child])) child++;
+        if (!comesBefore(heap[child], key)) break;
+        heap[index] = heap[child];
+        index = child;
+    }
+    heap[index] = key;
+}
+
+/* The keys are heapified bottom-up in O(N), and then the smallest key is dequeued N times, just like pqSort on a
+ * vector but with 8-byte keys in place of whole DataPoints. Breaking ties on the index makes the sort stable.
+ */
+Vector<int> pqSort(const MappedDataPointFile& file) {
+    int n = file.size();
+    Vector<SortKey> heap;
+    for (int i = 0; i < n; i++) {
+        heap.add({ file.priority(i), i });
+    }
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        bubbleDownKey(heap, i, n);
+    }
+    Vector<int> order;
+    for (int remaining = n; remaining > 0; remaining--) {
+        order.add(heap[0].index);
+        heap[0] = heap[remaining - 1];
+        bubbleDownKey(heap, 0, remaining - 1);
+    }
+    return order;
+}
+
+/* This function streams every element through a TopKAccumulator, which keeps the best k seen so far in a bounded
+ * min-heap. An element that can't beat the weakest one kept is thrown away with one comparison, and one that can
+ * replaces it in O(log k) time. In the end, we ask the accumulator for the top k values in the correct sorted order.
  */
 Vector<DataPoint> topK(istream& stream, int k) {
-    DataPoint cur;
-    PQSortedArray data;
-    Vector<DataPoint> trueData;
-    while (stream >> cur) {
-        if (data.size() < k) {
-            // Enqueue sorts the array in the correct order.
-            data.enqueue(cur);
-            trueData.add(cur);
-        }
-        else {
-            // The higher priority values replace the lowest priority values, still in the correct sorted order.
-            if (cur.priority > data.peek().priority) {
-                data.dequeue();
-                data.enqueue(cur);
+    PQStats ignored;
+    return topK(stream, k, ignored);
+}
+
+Vector<DataPoint> topK(istream& stream, int k, PQStats& stats) {
+    DataPointReader reader(stream);
+    return topK(reader, k, stats);
+}
+
+/* Same as above, but the records come from a DataPointReader. The label of a record is only copied out of the
+ * reader's buffer if the record makes it into the top k so far.
+ */
+Vector<DataPoint> topK(DataPointReader& reader, int k) {
+    PQStats ignored;
+    return topK(reader, k, ignored);
+}
+
+Vector<DataPoint> topK(DataPointReader& reader, int k, PQStats& stats) {
+    DataPointView cur;
+    TopKAccumulator best(k);
+    while (reader.next(cur)) {
+        if (best.wouldAccept(cur.priority)) {
+            best.offer(DataPoint{ string(cur.label), cur.priority });
+        }
+    }
+    stats += best.stats();
+    return best.results();
+}
+
+/* Same as above, over the priority array of a mapped binary file. */
+Vector<DataPoint> topK(const MappedDataPointFile& file, int k) {
+    TopKAccumulator best(k);
+    for (int i = 0; i < file.size(); i++) {
+        int priority = file.priority(i);
+        if (best.wouldAccept(priority)) {
+            best.offer(DataPoint{ string(file.label(i)), priority });
+        }
+    }
+    return best.results();
+}
+
+/* One element of the topKInterned window, with its position in the stream. */
+struct InternedEntry {
+    int priority;
+    uint32_t labelId;
+    long long seq;
+};
+
+/* Ranks elements the same way TopKAccumulator does: higher priority first, then earlier in the stream. As the
+ * comparator of the standard heap algorithms it puts the element that ranks lowest at the front of the window.
+ */
+static bool ranksAbove(const InternedEntry& a, const InternedEntry& b) {
+    return a.priority > b.priority || (a.priority == b.priority && a.seq < b.seq);
+}
+
+/* A later element only gets into a full window with a strictly higher priority than the weakest one kept, which
+ * breaks ties in favor of the earlier element, as topK does.
+ */
+Vector<DataPoint> topKInterned(istream& stream, int k, LabelPool& pool) {
+    DataPointReader reader(stream);
+    DataPointView cur;
+    vector<InternedEntry> window;
+    for (long long seq = 0; reader.next(cur); seq++) {
+        if ((int) window.size() < k) {
+            window.push_back({ cur.priority, pool.intern(cur.label), seq });
+            push_heap(window.begin(), window.end(), ranksAbove);
+        } else if (k > 0 && cur.priority > window.front().priority) {
+            pop_heap(window.begin(), window.end(), ranksAbove);
+            window.back() = { cur.priority, pool.intern(cur.label), seq };
+            push_heap(window.begin(), window.end(), ranksAbove);
+        }
+    }
+    sort(window.begin(), window.end(), ranksAbove);
+    Vector<DataPoint> result;
+    for (const InternedEntry& entry : window) {
+        result.add(pool.toDataPoint({ entry.labelId, entry.priority }));
+    }
+    return result;
+}
+
+/* Records parsed by the pipelinedTopK reader thread, with their labels packed end to end in one string. */
+struct RecordBatch {
+    struct Record {
+        size_t labelStart;
+        size_t labelLength;
+        int priority;
+    };
+    string labels;
+    vector<Record> records;
+};
+
+/* Number of batches pipelinedTopK passes around, which is how far the reader can get ahead of the selector. */
+static const int kPipelineDepth = 8;
+
+/* The reader takes an empty batch, fills it with the next batchSize records minus those that can't make the top k,
+ * and passes it on. The selector offers each record of a full batch to the accumulator and passes the batch back,
+ * then tells the reader the new threshold. The threshold only goes up, so the reader only ever drops a record that
+ * the selector would have rejected anyway, and the records that get through keep their order, which is all the
+ * tie-breaking needs. A nullptr batch marks the end of the stream.
+ */
+Vector<DataPoint> pipelinedTopK(istream& stream, int k, int batchSize) {
+    if (batchSize < 1) {
+        error("The batch size must be at least one");
+    }
+    vector<RecordBatch> batches(kPipelineDepth);
+    SpscRing<RecordBatch*> fullBatches(kPipelineDepth);
+    SpscRing<RecordBatch*> emptyBatches(kPipelineDepth);
+    for (RecordBatch& batch : batches) {
+        batch.records.reserve(batchSize);
+        emptyBatches.push(&batch);
+    }
+    atomic<long long> threshold(LLONG_MIN);
+
+    thread reader([&]() {
+        DataPointReader parser(stream);
+        DataPointView cur;
+        bool more = true;
+        while (more) {
+            RecordBatch* batch = emptyBatches.pop();
+            batch->labels.clear();
+            batch->records.clear();
+            for (int i = 0; i < batchSize && (more = parser.next(cur)); i++) {
+                if (cur.priority <= threshold.load(memory_order_relaxed)) continue;
+                batch->records.push_back({ batch->labels.size(), cur.label.size(), cur.priority });
+                batch->labels.append(cur.label);
+            }
+            fullBatches.push(batch);
+        }
+        fullBatches.push(nullptr);
+    });
+
+    TopKAccumulator best(k);
+    while (RecordBatch* batch = fullBatches.pop()) {
+        for (const RecordBatch::Record& record : batch->records) {
+            if (best.wouldAccept(record.priority)) {
+                best.offer(DataPoint{ batch->labels.substr(record.labelStart, record.labelLength), record.priority });
             }
         }
+        threshold.store(best.threshold(), memory_order_relaxed);
+        emptyBatches.push(batch);
     }
-    // Since it's easier to remove from the back of an array, we add to the final vector this way for simplicity.
-    if (trueData.size() > 0) {
-        for (int i = k - 1; i >= 0; i--) {
-            trueData[i] = data.dequeue();
+    reader.join();
+    return best.results();
+}
+
+/* Size of the blocks findRecordStart scans the file in. */
+static const int kBlockSize = 1 << 22;
+
+/* Each worker numbers its elements from pieceIndex << kPieceShift, so the positions of all elements in one piece
+ * come after those in earlier pieces and ties are broken the same way as in a single pass over the file.
+ */
+static const int kPieceShift = 40;
+
+/* Returns the offset of the first record that starts at or after offset. Records are written back to back as
+ * { "label", priority }, so a record starts at a '{' whose previous non-space character is a '}'. A label could
+ * contain that pattern too; the workers catch that case because their piece then doesn't parse cleanly.
+ */
+static streamoff findRecordStart(istream& in, streamoff offset, streamoff fileSize) {
+    if (offset <= 0) return 0;
+    in.clear();
+    in.seekg(offset - 1);
+    vector<char> block(kBlockSize);
+    streamoff pos = offset - 1;
+    bool afterClose = false;
+    while (pos < fileSize) {
+        in.read(block.data(), block.size());
+        streamsize numRead = in.gcount();
+        if (numRead <= 0) break;
+        for (streamsize i = 0; i < numRead; i++, pos++) {
+            char ch = block[i];
+            if (ch == '}') {
+                afterClose = true;
+            } else if (ch == '{' && afterClose && pos >= offset) {
+                return pos;
+            } else if (!isspace(ch)) {
+                afterClose = false;
+            }
         }
     }
-    return trueData;
+    return fileSize;
+}
+
+/* Offers every record in the byte range [start, end) of the file to best. Returns false if the range doesn't hold a
+ * whole number of well-formed records, which means start or end was not really a record boundary.
+ */
+static bool topKOfRange(const string& path, streamoff start, streamoff end, TopKAccumulator& best) {
+    ifstream in(path, ios::binary);
+    in.seekg(start);
+    DataPointReader reader(in, end - start);
+    DataPointView cur;
+    while (reader.next(cur)) {
+        if (best.wouldAccept(cur.priority)) {
+            best.offer(DataPoint{ string(cur.label), cur.priority });
+        }
+    }
+    return !reader.failed();
+}
+
+/* This function splits the file into one piece per thread, cutting at record boundaries, and runs an independent
+ * TopKAccumulator over each piece. The per-piece winners are then merged into the overall top k. If any boundary
+ * turns out to be inside a label, the pieces are thrown away and the file is read again with the serial topK.
+ */
+Vector<DataPoint> parallelTopK(const string& path, int k, int numThreads) {
+    ifstream in(path, ios::binary);
+    if (!in) error("Cannot open file " + path);
+    in.seekg(0, ios::end);
+    streamoff fileSize = in.tellg();
+    numThreads = max(numThreads, 1);
+
+    vector<streamoff> starts = { 0 };
+    for (int i = 1; i < numThreads; i++) {
+        starts.push_back(max(starts.back(), findRecordStart(in, fileSize * i / numThreads, fileSize)));
+    }
+    starts.push_back(fileSize);
+
+    // Every accumulator exists before any thread starts, and each thread
+    // holds a pointer to its own, so nothing it reads moves under it.
+    vector<unique_ptr<TopKAccumulator>> pieces;
+    for (int i = 0; i < numThreads; i++) {
+        pieces.push_back(make_unique<TopKAccumulator>(k));
+        pieces[i]->setNextSequence((long long) i << kPieceShift);
+    }
+    vector<char> parsedCleanly(numThreads, false);
+    vector<thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        TopKAccumulator* piece = pieces[i].get();
+        workers.emplace_back([&, i, piece]() {
+            parsedCleanly[i] = topKOfRange(path, starts[i], starts[i + 1], *piece);
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        if (!parsedCleanly[i]) {
+            in.clear();
+            in.seekg(0);
+            return topK(in, k);
+        }
+    }
+    TopKAccumulator best(k);
+    for (int i = 0; i < numThreads; i++) {
+        best.merge(*pieces[i]);
+    }
+    return best.results();
+}
+
+/* The label of each record is copied into the same scratch DataPoint, which
+ * only allocates when a label is longer than any before it.
+ */
+void mergeSorted(const Vector<istream*>& streams, ostream& out) {
+    LoserTreeMerge merge(streams);
+    DataPoint scratch;
+    while (merge.next(scratch)) {
+        out << scratch << "\n";
+    }
+    if (merge.failed()) {
+        error("Malformed DataPoint text in a stream being merged");
+    }
 }
 
 
@@ -82,6 +477,290 @@ stringstream asStream(int start, int stop) {
     return result;
 }
 
+/* Helper function that writes the data points to a file in the temp directory and returns its path. */
+static string writeTempFile(const string& name, const Vector<DataPoint>& dataPoints) {
+    string path = (filesystem::temp_directory_path() / name).string();
+    ofstream out(path, ios::binary);
+    for (const DataPoint& pt: dataPoints) {
+        out << pt << "\n";
+    }
+    return path;
+}
+
+/* Checks that v is sorted by priority and, if stable, that equal priorities are in increasing order of label. */
+static void expectSorted(const Vector<DataPoint>& v, bool stable) {
+    for (int i = 1; i < v.size(); i++) {
+        EXPECT(v[i - 1].priority <= v[i].priority);
+        if (stable && v[i - 1].priority == v[i].priority) {
+            EXPECT(stringToInteger(v[i - 1].label) < stringToInteger(v[i].label));
+        }
+    }
+}
+
+STUDENT_TEST("Every pqSort variant sorts, and the stable ones keep ties in order") {
+    for (int n : { 0, 1, 2, 100, 255, 256, 5000 }) {
+        Vector<DataPoint> input;
+        for (int i = 0; i < n; i++) {
+            input.add({ integerToString(i), randomInteger(-20, 20) * 50000000 });
+        }
+        Vector<DataPoint> v = input;
+        pqSort(v);
+        expectSorted(v, true);
+        v = input;
+        pqSort<PQSortedArray>(v);
+        expectSorted(v, true);
+        v = input;
+        pqRadixSort(v);
+        expectSorted(v, true);
+        v = input;
+        pqSort<PQHeap>(v);
+        expectSorted(v, false);
+        v = input;
+        pqSort<DaryHeap<4>>(v);
+        expectSorted(v, false);
+        v = input;
+        pqSort<PQKeyHeap>(v);
+        expectSorted(v, false);
+        v = input;
+        pqHeapSort(v);
+        expectSorted(v, false);
+        EXPECT_EQUAL(v.size(), n);
+    }
+}
+
+STUDENT_TEST("topK accepts a DataPointReader over asStream") {
+    Vector<DataPoint> input = { { "A", 1 }, { "B", 2 }, { "C", 3 }, { "D", 4 } };
+    stringstream stream = asStream(input);
+    DataPointReader reader(stream);
+    Vector<DataPoint> expected = { { "D", 4 }, { "C", 3 } };
+    EXPECT_EQUAL(topK(reader, 2), expected);
+
+    int n = 100000;
+    stringstream range = asStream(1, n);
+    DataPointReader rangeReader(range);
+    Vector<DataPoint> result = topK(rangeReader, 5);
+    EXPECT_EQUAL(result.size(), 5);
+    EXPECT_EQUAL(result[0].priority, n);
+    EXPECT_EQUAL(result[4].priority, n - 4);
+}
+
+STUDENT_TEST("topK and pqSort over a mapped binary file match the text versions") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 5000; i++) {
+        input.add({ "point " + integerToString(i), randomInteger(0, 100) });
+    }
+    string path = (filesystem::temp_directory_path() / "pqclient-mapped.bin").string();
+    stringstream text = asStream(input);
+    convertToBinary(text, path);
+    {
+        MappedDataPointFile file(path);
+        for (int k : { 0, 1, 10, 5000, 6000 }) {
+            stringstream stream = asStream(input);
+            EXPECT_EQUAL(topK(file, k), topK(stream, k));
+        }
+
+        Vector<int> order = pqSort(file);
+        EXPECT_EQUAL(order.size(), input.size());
+        for (int i = 1; i < order.size(); i++) {
+            const DataPoint& prev = input[order[i - 1]];
+            const DataPoint& cur = input[order[i]];
+            EXPECT(prev.priority < cur.priority || (prev.priority == cur.priority && order[i - 1] < order[i]));
+        }
+    }
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("topK time trial, text stream versus mapped binary file") {
+    int n = 2000000;
+    Vector<DataPoint> input;
+    for (int i = 0; i < n; i++) {
+        input.add({ "label " + integerToString(i), randomInteger(1, n) });
+    }
+    string path = (filesystem::temp_directory_path() / "pqclient-mapped.bin").string();
+    stringstream text = asStream(input);
+    convertToBinary(text, path);
+    stringstream stream = asStream(input);
+    TIME_OPERATION(n, topK(stream, 1000));
+    {
+        MappedDataPointFile file(path);
+        TIME_OPERATION(n, topK(file, 1000));
+        TIME_OPERATION(n, pqSort(file));
+    }
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("topKInterned matches topK, including label order for ties") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 5000; i++) {
+        input.add({ "label " + integerToString(randomInteger(0, 50)), randomInteger(0, 100) });
+    }
+    for (int k : { 0, 1, 10, 1000, 6000 }) {
+        stringstream plain = asStream(input);
+        stringstream interned = asStream(input);
+        LabelPool pool;
+        EXPECT_EQUAL(topKInterned(interned, k, pool), topK(plain, k));
+        EXPECT(pool.size() <= 51);
+    }
+}
+
+STUDENT_TEST("topK time trial, DataPoint window versus interned window") {
+    int n = 2000000;
+    Vector<DataPoint> input;
+    for (int i = 0; i < n; i++) {
+        input.add({ "feed/source-" + integerToString(i % 1000) + "/event-type", randomInteger(1, n) });
+    }
+    for (int k = 1000; k <= 100000; k *= 10) {
+        stringstream plain = asStream(input);
+        stringstream interned = asStream(input);
+        LabelPool pool;
+        TIME_OPERATION(k, topK(plain, k));
+        TIME_OPERATION(k, topKInterned(interned, k, pool));
+    }
+}
+
+STUDENT_TEST("parallelTopK matches topK, including label order for ties") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 20000; i++) {
+        input.add({ "point " + integerToString(i), randomInteger(0, 200) });
+    }
+    string path = writeTempFile("pqclient-parallel-topk.txt", input);
+    for (int k : { 1, 10, 1000, 30000 }) {
+        stringstream stream = asStream(input);
+        Vector<DataPoint> expected = topK(stream, k);
+        for (int numThreads : { 1, 2, 3, 8 }) {
+            EXPECT_EQUAL(parallelTopK(path, k, numThreads), expected);
+        }
+    }
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("parallelTopK with many threads over a large file, for the thread sanitizer") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 200000; i++) {
+        input.add({ "record " + integerToString(i), randomInteger(0, 1000) });
+    }
+    string path = writeTempFile("pqclient-parallel-topk-many.txt", input);
+    stringstream stream = asStream(input);
+    Vector<DataPoint> expected = topK(stream, 50);
+    for (int numThreads : { 4, 16, 33, 64 }) {
+        EXPECT_EQUAL(parallelTopK(path, 50, numThreads), expected);
+    }
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("parallelTopK on tiny files and labels that look like record boundaries") {
+    string path = writeTempFile("pqclient-parallel-topk.txt", {});
+    EXPECT(parallelTopK(path, 5, 4).isEmpty());
+
+    Vector<DataPoint> input = { { "A", 1 }, { "} {", 3 }, { "}\n{ \"x\", 9 }", 3 }, { "D", 4 } };
+    for (int i = 0; i < 100; i++) {
+        input.add({ "} {", i % 5 });
+    }
+    path = writeTempFile("pqclient-parallel-topk.txt", input);
+    stringstream stream = asStream(input);
+    Vector<DataPoint> expected = topK(stream, 30);
+    for (int numThreads = 1; numThreads <= 16; numThreads++) {
+        EXPECT_EQUAL(parallelTopK(path, 30, numThreads), expected);
+    }
+    filesystem::remove(path);
+    EXPECT_ERROR(parallelTopK(path, 5, 4));
+}
+
+STUDENT_TEST("pipelinedTopK matches topK, including label order for ties") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 20000; i++) {
+        input.add({ "point " + integerToString(i), randomInteger(0, 200) });
+    }
+    for (int k : { 0, 1, 10, 1000, 30000 }) {
+        stringstream stream = asStream(input);
+        Vector<DataPoint> expected = topK(stream, k);
+        for (int batchSize : { 1, 7, 4096, 100000 }) {
+            stringstream again = asStream(input);
+            EXPECT_EQUAL(pipelinedTopK(again, k, batchSize), expected);
+        }
+    }
+
+    stringstream empty;
+    EXPECT(pipelinedTopK(empty, 5).isEmpty());
+    stringstream malformed("{ \"A\", 1 } { \"B\", 2 } { oops");
+    stringstream malformedAgain(malformed.str());
+    EXPECT_EQUAL(pipelinedTopK(malformed, 5), topK(malformedAgain, 5));
+    EXPECT_ERROR(pipelinedTopK(empty, 5, 0));
+}
+
+STUDENT_TEST("mergeSorted of pqSorted shards matches pqSort of everything") {
+    Vector<DataPoint> all;
+    vector<stringstream> shards(50);
+    for (int i = 0; i < (int) shards.size(); i++) {
+        Vector<DataPoint> shard;
+        for (int j = randomInteger(0, 400); j > 0; j--) {
+            shard.add({ "shard " + integerToString(i) + " #" + integerToString(j), randomInteger(0, 100) });
+        }
+        pqSort(shard);
+        for (const DataPoint& pt : shard) {
+            shards[i] << pt << "\n";
+            all.add(pt);
+        }
+    }
+    pqSort(all);
+
+    Vector<istream*> streams;
+    for (stringstream& shard : shards) {
+        streams.add(&shard);
+    }
+    stringstream merged;
+    mergeSorted(streams, merged);
+    DataPointReader reader(merged);
+    Vector<DataPoint> result;
+    DataPoint pt;
+    while (reader.next(pt)) {
+        result.add(pt);
+    }
+    EXPECT_EQUAL(result, all);
+
+    stringstream out;
+    mergeSorted({}, out);
+    EXPECT(out.str().empty());
+    stringstream bad("{ \"A\", 1 } oops");
+    EXPECT_ERROR(mergeSorted({ &bad }, out));
+    stringstream unsorted("{ \"A\", 2 } { \"B\", 1 }");
+    EXPECT_ERROR(mergeSorted({ &unsorted }, out));
+}
+
+STUDENT_TEST("pipelinedTopK time trial, serial versus pipelined on a stringstream and a file") {
+    int n = 2000000;
+    Vector<DataPoint> input;
+    for (int i = 0; i < n; i++) {
+        input.add({ "label " + integerToString(i), randomInteger(1, n) });
+    }
+    stringstream serial = asStream(input);
+    stringstream pipelined = asStream(input);
+    TIME_OPERATION(n, topK(serial, 1000));
+    TIME_OPERATION(n, pipelinedTopK(pipelined, 1000));
+
+    string path = writeTempFile("pqclient-pipelined-topk.txt", input);
+    {
+        ifstream serialFile(path);
+        ifstream pipelinedFile(path);
+        TIME_OPERATION(n, topK(serialFile, 1000));
+        TIME_OPERATION(n, pipelinedTopK(pipelinedFile, 1000));
+    }
+    filesystem::remove(path);
+}
+
+STUDENT_TEST("parallelTopK time trial, 1 to 8 threads") {
+    int n = 2000000;
+    Vector<DataPoint> input;
+    for (int i = 0; i < n; i++) {
+        input.add({ "", randomInteger(1, n) });
+    }
+    string path = writeTempFile("pqclient-parallel-topk.txt", input);
+    for (int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+        TIME_OPERATION(numThreads, parallelTopK(path, 1000, numThreads));
+    }
+    filesystem::remove(path);
+}
+
 STUDENT_TEST("Timing tests") {
     for (int n = 1000; n < 10*1000; n *= 2) {
         Vector<DataPoint> v;
@@ -118,17 +797,29 @@ PROVIDED_TEST("pqSort 100 random elements") {
     }
 }
 
-PROVIDED_TEST("pqSort time trial") {
-    int startSize = 1000;
-    for (int n = startSize; n < 10*startSize; n *= 2) {
+/* Times one sort variant on random input, for n from 1000 up to maxSize in powers of ten. */
+static void timeSortVariant(void (*sortFn)(Vector<DataPoint>&), int maxSize) {
+    for (int n = 1000; n <= maxSize; n *= 10) {
         Vector<DataPoint> v;
         for (int i = 0; i < n; i++) {
             v.add({ "", randomInteger(1, n) });
         }
-        TIME_OPERATION(n, pqSort(v));
+        TIME_OPERATION(n, sortFn(v));
     }
 }
 
+PROVIDED_TEST("pqSort time trial") {
+    int maxSize = 1000 * 1000;
+    timeSortVariant(pqSort, maxSize);
+    timeSortVariant(pqSort<PQHeap>, maxSize);
+    timeSortVariant(pqSort<DaryHeap<4>>, maxSize);
+    timeSortVariant(pqSort<PQKeyHeap>, maxSize);
+    timeSortVariant(pqHeapSort, maxSize);
+    timeSortVariant(pqRadixSort, maxSize);
+    // O(N^2) element moves, so only up to 100000 elements
+    timeSortVariant(pqSort<PQSortedArray>, 100 * 1000);
+}
+
 
 /* Constant used for sizing the tests below this point. */
 const int kMany = 100000;
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include "datapointreader.h"
+#include "datapointfile.h"
+#include "labelpool.h"
+#include "pqstats.h"
+#include <istream>
+#include <ostream>
+#include <string>
+
+/**
+ * Rearranges the elements of v into increasing order of priority.
+ * The sort is stable: elements with equal priority keep their order.
+ * Small vectors are pushed through a PQSortedArray, and large ones
+ * are sorted with pqRadixSort.
+ */
+void pqSort(Vector<DataPoint>& v);
+
+/**
+ * Same as pqSort above, and adds the work done by the sort into stats:
+ * the queue's counts for small vectors, and the moves and buffer of the
+ * radix sort for large ones. Stats are only counted in builds with
+ * PQ_ENABLE_STATS defined.
+ */
+void pqSort(Vector<DataPoint>& v, PQStats& stats);
+
+/**
+ * Rearranges the elements of v into increasing order of priority by
+ * pushing them all through a priority queue of type PQueue and then
+ * dequeueing them back into v. The sort is stable only if PQueue
+ * dequeues equal priorities in the order they were enqueued, which
+ * PQSortedArray does and the heaps don't.
+ */
+template <typename PQueue>
+void pqSort(Vector<DataPoint>& v) {
+    PQueue pq;
+    for (int i = 0; i < v.size(); i++) {
+        pq.enqueue(std::move(v[i]));
+    }
+    for (int i = 0; i < v.size(); i++) {
+        v[i] = pq.dequeue();
+    }
+}
+
+/**
+ * Rearranges the elements of v into increasing order of priority with an
+ * in-place heapsort: v itself is used as a max-heap, so no extra buffer
+ * is needed. Runs in O(N log N) time. The sort is NOT stable.
+ */
+void pqHeapSort(Vector<DataPoint>& v);
+
+/**
+ * Rearranges the elements of v into increasing order of priority with an
+ * LSD radix sort on the priority, one byte at a time. Runs in O(N) time
+ * and uses an O(N) buffer of 8-byte keys, not of DataPoints. The sort is
+ * stable.
+ */
+void pqRadixSort(Vector<DataPoint>& v);
+
+/**
+ * Returns the indexes of the records in the mapped file, ordered by
+ * increasing priority, with equal priorities in file order. The records
+ * are sorted through a heap of (priority, index) keys read straight from
+ * the mapping, so no DataPoints are built.
+ */
+Vector<int> pqSort(const MappedDataPointFile& file);
+
+/**
+ * Reads DataPoints from the stream and returns the k elements with
+ * the largest priority values, in decreasing order of priority. Ties
+ * are broken in favor of the element that appears first in the stream.
+ */
+Vector<DataPoint> topK(std::istream& stream, int k);
+
+/**
+ * Same as topK above, reading the DataPoints with the given reader.
+ */
+Vector<DataPoint> topK(DataPointReader& reader, int k);
+
+/**
+ * Same as the topK versions above, and adds the work done by the window
+ * of the best k into stats. Stats are only counted in builds with
+ * PQ_ENABLE_STATS defined.
+ */
+Vector<DataPoint> topK(std::istream& stream, int k, PQStats& stats);
+Vector<DataPoint> topK(DataPointReader& reader, int k, PQStats& stats);
+
+/**
+ * Same as topK above, scanning the priorities of a mapped binary file.
+ * Only the records that make it into the top k so far have their labels
+ * copied out of the mapping.
+ */
+Vector<DataPoint> topK(const MappedDataPointFile& file, int k);
+
+/**
+ * Same as topK on the stream, but the window of the best k so far holds
+ * label ids from the pool instead of DataPoints, so it takes 16 bytes per
+ * element and no strings. Only the labels of records that make it into
+ * the window are interned, and DataPoints are built for the results only.
+ */
+Vector<DataPoint> topKInterned(std::istream& stream, int k, LabelPool& pool);
+
+/**
+ * Returns the same result as topK on the stream, but parses the stream on
+ * a reader thread while the calling thread does the selecting. The reader
+ * packs the records into batches of batchSize and hands them over through
+ * a lock-free ring, and the empty batches come back through another ring,
+ * so the two threads never wait on a lock and the batches are reused.
+ * The calling thread publishes the priority a record must beat after each
+ * batch, and the reader drops records at or below it without copying
+ * their labels.
+ *
+ * If batchSize is less than one, this function calls error().
+ */
+Vector<DataPoint> pipelinedTopK(std::istream& stream, int k, int batchSize = 4096);
+
+/**
+ * Returns the same result as topK on the DataPoints stored in the file at
+ * path, but splits the file into pieces at record boundaries and finds
+ * the top k of each piece on its own thread before merging them.
+ */
+Vector<DataPoint> parallelTopK(const std::string& path, int k, int numThreads);
+
+/**
+ * Reads the DataPoints of the streams, each of which must already be
+ * sorted by increasing priority, such as the outputs of pqSort, and writes
+ * them to out as one sorted sequence, one record per line. The streams are
+ * merged through a LoserTreeMerge, so each record costs one comparison per
+ * level of a tree over the streams, and labels are not copied on the way.
+ * Of records with equal priority, those from earlier streams come first.
+ *
+ * If a stream isn't sorted or holds malformed input, this function calls
+ * error().
+ */
+void mergeSorted(const Vector<std::istream*>& streams, std::ostream& out);
@@ -0,0 +1,346 @@
+/* An external-memory priority queue: an in-memory PQHeap that spills sorted
+ * runs to disk when it goes over budget, merged back on dequeue.
+ */
+#include "pqexternal.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <system_error>
+#include <unistd.h>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/*
+ * Estimated memory held by an element in the heap: its slot in the array
+ * plus its label's characters. Short labels that fit in the string itself
+ * are counted a little high, which only makes the queue spill earlier.
+ */
+static long long bytesFor(const DataPoint& elem) {
+    return sizeof(DataPoint) + elem.label.size();
+}
+
+/*
+ * Deletes a run file whose elements have all been used. clear() runs in
+ * the destructor, so an error deleting the file is ignored rather than
+ * thrown; at worst the file is left behind in the temp directory.
+ */
+static void removeRunFile(const string& path) {
+    error_code ignored;
+    filesystem::remove(path, ignored);
+}
+
+PQExternal::PQExternal(long long memoryBudget, const string& tempDirectory) {
+    if (memoryBudget <= 0)
+        error("PQExternal memory budget must be positive");
+    _budget = memoryBudget;
+    _tempDirectory = tempDirectory.empty() ? filesystem::temp_directory_path().string() : tempDirectory;
+    _heapBytes = 0;
+    _numOnDisk = 0;
+}
+
+PQExternal::~PQExternal() {
+    clear();
+}
+
+/*
+ * The element always goes into the heap first, so that the run written by
+ * a spill is sorted, and a spill leaves the heap empty.
+ */
+void PQExternal::enqueue(DataPoint&& elem) {
+    _heapBytes += bytesFor(elem);
+    _heap.enqueue(std::move(elem));
+    if (_heapBytes > _budget) {
+        spill();
+    }
+}
+
+void PQExternal::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * Takes the heap's front unless the head of the best run is smaller. A run
+ * that is used up is deleted right away.
+ */
+DataPoint PQExternal::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    if (_runs.empty() || (!_heap.isEmpty() && _heap.peekPriority() <= headPriority(0))) {
+        DataPoint result = _heap.dequeue();
+        _heapBytes -= bytesFor(result);
+        return result;
+    }
+    unique_ptr<Run> run = popRun();
+    DataPoint result = run->file->get(run->next++);
+    _numOnDisk--;
+    if (run->next < run->file->size()) {
+        pushRun(std::move(run));
+    } else {
+        run->file.reset();
+        removeRunFile(run->path);
+    }
+    return result;
+}
+
+DataPoint PQExternal::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    if (_runs.empty() || (!_heap.isEmpty() && _heap.peekPriority() <= headPriority(0))) {
+        return _heap.peek();
+    }
+    return _runs.front()->file->get(_runs.front()->next);
+}
+
+bool PQExternal::isEmpty() const {
+    return size() == 0;
+}
+
+int PQExternal::size() const {
+    return _heap.size() + _numOnDisk;
+}
+
+int PQExternal::numRuns() const {
+    return _runs.size();
+}
+
+void PQExternal::clear() {
+    _heap.clear();
+    _heapBytes = 0;
+    for (unique_ptr<Run>& run : _runs) {
+        run->file.reset();
+        removeRunFile(run->path);
+    }
+    _runs.clear();
+    _numOnDisk = 0;
+}
+
+void PQExternal::validateInternalState() {
+    _heap.validateInternalState();
+    int numOnDisk = 0;
+    for (int i = 0; i < (int) _runs.size(); i++) {
+        const Run& run = *_runs[i];
+        if (run.next >= run.file->size())
+            error("Used up run still open: " + run.path);
+        for (int j = run.next + 1; j < run.file->size(); j++) {
+            if (run.file->priority(j - 1) > run.file->priority(j))
+                error("Run out of order at record " + integerToString(j) + ": " + run.path);
+        }
+        if (i > 0 && headPriority((i - 1) / 2) > headPriority(i))
+            error("Run heads out of order at index " + integerToString(i));
+        numOnDisk += run.file->size() - run.next;
+    }
+    if (numOnDisk != _numOnDisk)
+        error("Runs hold " + integerToString(numOnDisk) + " elements, not " + integerToString(_numOnDisk));
+}
+
+/*
+ * Drains the heap in order into a new run file and maps it for reading.
+ * Each run gets a name that is unique to this process. If the file can't
+ * be written or mapped, such as on a full disk, it is deleted and the
+ * elements go back into the heap before the error is passed on, so the
+ * queue loses nothing.
+ */
+void PQExternal::spill() {
+    static atomic<long> numSpills(0);
+    unique_ptr<Run> run(new Run);
+    run->path = (filesystem::path(_tempDirectory) / ("pqexternal-" + integerToString(getpid()) + "-"
+                + longToString(numSpills++) + ".bin")).string();
+    Vector<DataPoint> sorted;
+    _heap.dequeueMany(_heap.size(), sorted);
+    try {
+        {
+            DataPointFileWriter writer(run->path);
+            for (const DataPoint& elem : sorted) {
+                writer.add(elem);
+            }
+            writer.finish();
+        }
+        run->file.reset(new MappedDataPointFile(run->path));
+    } catch (...) {
+        removeRunFile(run->path);
+        _heap.enqueueAll(sorted);
+        throw;
+    }
+    _heapBytes = 0;
+    run->file->adviseSequential();
+    run->next = 0;
+    _numOnDisk += run->file->size();
+    pushRun(std::move(run));
+}
+
+/*
+ * Returns the priority of the head record of the run at index i of the
+ * run heap.
+ */
+int PQExternal::headPriority(int i) const {
+    return _runs[i]->file->priority(_runs[i]->next);
+}
+
+/*
+ * The run heap is a min-heap on head priorities, kept with the standard
+ * heap algorithms.
+ */
+bool PQExternal::headAfter(const unique_ptr<Run>& a, const unique_ptr<Run>& b) {
+    return a->file->priority(a->next) > b->file->priority(b->next);
+}
+
+/*
+ * Removes and returns the run with the smallest head.
+ */
+unique_ptr<PQExternal::Run> PQExternal::popRun() {
+    pop_heap(_runs.begin(), _runs.end(), headAfter);
+    unique_ptr<Run> run = std::move(_runs.back());
+    _runs.pop_back();
+    return run;
+}
+
+void PQExternal::pushRun(unique_ptr<Run> run) {
+    _runs.push_back(std::move(run));
+    push_heap(_runs.begin(), _runs.end(), headAfter);
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+/* A budget of a few elements, so that the tests spill constantly. */
+static const long long kTinyBudget = 4 * (sizeof(DataPoint) + 4);
+
+STUDENT_TEST("PQExternal example from writeup, validate each step") {
+    PQExternal pq(kTinyBudget);
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    pq.validateInternalState();
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.numRuns() > 0);
+    EXPECT_EQUAL(pq.size(), 9);
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.peek().priority, i);
+        DataPoint cur = pq.dequeue();
+        EXPECT_EQUAL(cur.priority, i);
+        EXPECT_EQUAL(cur.label, string(1, "TGBRASKOV"[i - 1]));
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.numRuns(), 0);
+    EXPECT_ERROR(PQExternal(0));
+}
+
+STUDENT_TEST("PQExternal: size/isEmpty/clear, and errors on an empty queue") {
+    PQExternal pq(kTinyBudget);
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+    for (int i = 0; i < 20; i++) {
+        EXPECT_EQUAL(pq.size(), i);
+        pq.enqueue({ "", i * 10 });
+    }
+    pq.clear();
+    pq.validateInternalState();
+    EXPECT(pq.isEmpty());
+    EXPECT_EQUAL(pq.numRuns(), 0);
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+}
+
+STUDENT_TEST("PQExternal, ascending, descending and duplicate sequences") {
+    PQExternal pq(kTinyBudget);
+    for (int i = 0; i < 20; i++) {
+        pq.enqueue({ "a" + integerToString(i), 2 * i });
+    }
+    for (int i = 19; i >= 0; i--) {
+        pq.enqueue({ "b" + integerToString(i), 2 * i + 1 });
+    }
+    for (int i = 0; i < 20; i++) {
+        pq.enqueue({ "c" + integerToString(i), 2 * i });
+    }
+    EXPECT_EQUAL(pq.size(), 60);
+    pq.validateInternalState();
+    int expected = 0;
+    while (!pq.isEmpty()) {
+        int priority = pq.dequeue().priority;
+        EXPECT_EQUAL(priority, expected);
+        if (priority % 2 == 1 || pq.isEmpty() || pq.peek().priority != priority) {
+            expected++;
+        }
+    }
+}
+
+STUDENT_TEST("PQExternal stress test, interleaved operations match PQHeap") {
+    PQExternal pq(200 * sizeof(DataPoint));
+    PQHeap reference;
+    for (int i = 0; i < 20000; i++) {
+        if (reference.isEmpty() || randomChance(0.6)) {
+            DataPoint dp = { "label " + integerToString(i), randomInteger(-10000, 10000) };
+            pq.enqueue(dp);
+            reference.enqueue(dp);
+        } else {
+            EXPECT_EQUAL(pq.dequeue().priority, reference.dequeue().priority);
+        }
+        EXPECT_EQUAL(pq.size(), reference.size());
+    }
+    pq.validateInternalState();
+    while (!reference.isEmpty()) {
+        EXPECT_EQUAL(pq.dequeue().priority, reference.dequeue().priority);
+    }
+    EXPECT_EQUAL(pq.numRuns(), 0);
+}
+
+STUDENT_TEST("PQExternal keeps every element when a spill fails") {
+    string missing = (filesystem::temp_directory_path() / "pqexternal-missing-directory").string();
+    filesystem::remove_all(missing);
+    PQExternal pq(kTinyBudget, missing);
+    for (int i = 4; i >= 1; i--) {
+        pq.enqueue({ integerToString(i), i });
+    }
+    EXPECT_EQUAL(pq.numRuns(), 0);
+
+    // the fifth element pushes the heap over budget, and the run can't be created
+    EXPECT_ERROR(pq.enqueue({ "0", 0 }));
+    EXPECT_EQUAL(pq.size(), 5);
+    EXPECT_EQUAL(pq.numRuns(), 0);
+    EXPECT(!filesystem::exists(missing));
+    pq.validateInternalState();
+    for (int i = 0; i <= 4; i++) {
+        EXPECT_EQUAL(pq.dequeue(), DataPoint({ integerToString(i), i }));
+    }
+    EXPECT(pq.isEmpty());
+}
+
+static void fillAndDrain(PQExternal& pq, const Vector<DataPoint>& input) {
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+    }
+    while (!pq.isEmpty()) {
+        pq.dequeue();
+    }
+}
+
+static void fillAndDrain(PQHeap& pq, const Vector<DataPoint>& input) {
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+    }
+    while (!pq.isEmpty()) {
+        pq.dequeue();
+    }
+}
+
+STUDENT_TEST("PQExternal timing test, budget of a tenth of the data against PQHeap") {
+    for (int n = 100000; n <= 1000000; n *= 10) {
+        Vector<DataPoint> input;
+        long long dataBytes = 0;
+        for (int i = 0; i < n; i++) {
+            input.add({ "a label of some length " + integerToString(i), randomInteger(0, n) });
+            dataBytes += sizeof(DataPoint) + input[i].label.size();
+        }
+        PQExternal external(dataBytes / 10);
+        PQHeap inMemory;
+        TIME_OPERATION(n, fillAndDrain(external, input));
+        TIME_OPERATION(n, fillAndDrain(inMemory, input));
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "datapoint.h"
+#include "datapointfile.h"
+#include "pqheap.h"
+#include "testing/MemoryDiagnostics.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Priority queue type for more elements than fit in memory.
+ *
+ * Elements are enqueued into an in-memory PQHeap until its contents pass a
+ * byte budget. The heap is then drained in order into a sorted run, which
+ * is written to a temp file in the binary DataPoint format and the heap
+ * starts over empty. The runs are memory-mapped with sequential read-ahead,
+ * and dequeue takes the smallest of the heap's front and the heads of all
+ * the runs, which are kept in a small heap of their own. The temp files are
+ * deleted as soon as their runs are used up, or when the queue is cleared
+ * or destroyed.
+ */
+class PQExternal {
+public:
+    /**
+     * Creates a new, empty priority queue that keeps about memoryBudget
+     * bytes of elements in memory and spills runs into tempDirectory, or
+     * into the system temp directory if none is given.
+     *
+     * If the budget is not positive, this function calls error().
+     */
+    PQExternal(long long memoryBudget, const std::string& tempDirectory = "");
+
+    /**
+     * Deletes any runs still on disk.
+     */
+    ~PQExternal();
+
+    /**
+     * Adds a new element into the queue. This operation runs in time
+     * O(log M), where M is the number of elements in memory, except when
+     * it pushes the heap over budget and the heap is spilled to disk.
+     *
+     * If the spill fails, such as on a full disk, this function calls
+     * error(), but the element and all the others stay in the queue.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue, in memory and
+     * on disk.
+     */
+    int size() const;
+
+    /**
+     * Returns the number of runs on disk.
+     */
+    int numRuns() const;
+
+    /**
+     * Removes all elements from the priority queue and deletes the runs.
+     */
+    void clear();
+
+    /**
+     * Confirms that the heap is valid, that every run is sorted from its
+     * head on, that the run heads are in heap order and that the element
+     * counts add up, and calls error() if not.
+     */
+    void validateInternalState();
+
+private:
+    struct Run {
+        std::string path;
+        std::unique_ptr<MappedDataPointFile> file;
+        int next;           // index of the head record
+    };
+
+    PQHeap _heap;           // elements in memory
+    long long _heapBytes;   // estimated bytes used by the elements in _heap
+    long long _budget;
+    std::string _tempDirectory;
+    std::vector<std::unique_ptr<Run>> _runs;   // runs on disk, kept as a heap by head priority
+    int _numOnDisk;         // elements left in all runs
+
+    void spill();
+    int headPriority(int run) const;
+    std::unique_ptr<Run> popRun();
+    void pushRun(std::unique_ptr<Run> run);
+    static bool headAfter(const std::unique_ptr<Run>& a, const std::unique_ptr<Run>& b);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQExternal(const PQExternal &) = delete;
+    void operator=(const PQExternal &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQExternal);
+};
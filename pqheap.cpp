@@ -4,6 +4,12 @@
 #include "random.h"
 #include "strlib.h"
 #include "datapoint.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include "pqarena.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
 #include "testing/SimpleTest.h"
 using namespace std;
 
@@ -13,12 +19,34 @@ const int INITIAL_CAPACITY = 10;
  * The constructor initializes all of the member variables needed for
  * an instance of the class. The allocated capacity
  * is initialized to a starting constant and a dynamic array of that
- * size is allocated. The number of filled slots is initially zero.
+ * size is allocated from the memory resource. The number of filled
+ * slots is initially zero.
  */
-PQHeap::PQHeap() {
+PQHeap::PQHeap(pmr::memory_resource* resource) {
+    _resource = resource;
     _numAllocated = INITIAL_CAPACITY;
-    _elements = new DataPoint[_numAllocated];
+    _elements = allocateElements(_resource, _numAllocated);
     _numFilled = 0;
+    PQ_COUNT(_stats.bytesAllocated += _numAllocated * (long long) sizeof(DataPoint));
+}
+
+/*
+ * Builds a heap out of all the elements of the vector at once. The
+ * elements are moved into the array in their original order and then
+ * heapified from the bottom up, which is O(N) instead of the O(N log N)
+ * it costs to enqueue them one by one.
+ */
+PQHeap::PQHeap(Vector<DataPoint> elements, pmr::memory_resource* resource) {
+    _resource = resource;
+    _numAllocated = max(INITIAL_CAPACITY, elements.size() + 1);
+    _elements = allocateElements(_resource, _numAllocated);
+    _numFilled = 0;
+    PQ_COUNT(_stats.bytesAllocated += _numAllocated * (long long) sizeof(DataPoint));
+    for (DataPoint& elem : elements) {
+        _elements[_numFilled++] = std::move(elem);
+    }
+    PQ_COUNT(_stats.moves += _numFilled);
+    heapify();
 }
 
 /*
@@ -27,34 +55,72 @@ PQHeap::PQHeap() {
  * memory used for elements is deallocated here.
  */
 PQHeap::~PQHeap() {
-    delete[] _elements;
+    freeElements(_resource, _elements, _numAllocated);
 }
 
 /*
- * Enqueues in bubbling up order.
+ * Enqueues in bubbling up order. Larger parents are moved down into the
+ * hole left by the new element, which is only moved once, into its final
+ * spot, so bubbling up never copies a label.
  */
-void PQHeap::enqueue(DataPoint elem) {
-    if (_numFilled == _numAllocated - 1) {
-        // Create array of double the size of _elements
-        DataPoint* newElements = new DataPoint[_numAllocated * 2];
-        for (int i = 0; i < _numFilled; i++) {
-            // Copy _elements into newElements
-            newElements[i] = _elements[i];
-        }
-        delete [] _elements;
-        _elements = newElements;
-        _numAllocated *= 2;
-    }
+void PQHeap::enqueue(DataPoint&& elem) {
+    ensureCapacity(_numFilled + 1);
     int childSpot = _numFilled;
-    int parentSpot = 1;
-    _elements[childSpot] = elem;
-    while (parentSpot != 0 && elem.priority < _elements[getParentIndex(childSpot)].priority) {
-        parentSpot = getParentIndex(childSpot);
-        _elements[childSpot] = _elements[parentSpot];
-        _elements[parentSpot] = elem;
+    PQ_COUNT(int depth = 0);
+    while (childSpot != 0 && elem.priority < _elements[getParentIndex(childSpot)].priority) {
+        int parentSpot = getParentIndex(childSpot);
+        _elements[childSpot] = std::move(_elements[parentSpot]);
         childSpot = parentSpot;
+        PQ_COUNT(depth++);
     }
+    _elements[childSpot] = std::move(elem);
     _numFilled ++;
+    PQ_COUNT(_stats.comparisons += depth + (childSpot != 0));
+    PQ_COUNT(_stats.moves += depth + 1);
+    PQ_COUNT(_stats.recordSift(depth));
+}
+
+/*
+ * Copies the element and enqueues the copy.
+ */
+void PQHeap::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * Builds the element from its parts and enqueues it without copying the
+ * label.
+ */
+void PQHeap::emplace(string label, int priority) {
+    enqueue(DataPoint{ std::move(label), priority });
+}
+
+/*
+ * Appends the whole batch to the end of the array and then restores the
+ * heap property in one bottom-up pass. When the batch is small compared to
+ * the heap it is cheaper to bubble each new element up on its own, since
+ * heapify always touches every parent in the array.
+ */
+void PQHeap::enqueueAll(const Vector<DataPoint>& elements) {
+    if (elements.size() < _numFilled / 2) {
+        for (const DataPoint& elem : elements) {
+            enqueue(elem);
+        }
+        return;
+    }
+    ensureCapacity(_numFilled + elements.size());
+    for (const DataPoint& elem : elements) {
+        _elements[_numFilled++] = elem;
+    }
+    PQ_COUNT(_stats.moves += elements.size());
+    heapify();
+}
+
+/*
+ * Enqueues the batch through enqueueAll.
+ */
+void PQHeap::enqueueMany(const Vector<DataPoint>& elements) {
+    enqueueAll(elements);
 }
 
 /*
@@ -68,36 +134,74 @@ DataPoint PQHeap::peek() const {
 }
 
 /*
- * Dequeues in bubbling down order.
+ * Peeks at the priority of the first element.
+ */
+int PQHeap::peekPriority() const {
+    if (isEmpty()) {
+        error("Cannot peek empty pqueue");
+    }
+    return _elements[0].priority;
+}
+
+/*
+ * Dequeues in bubbling down order. The root is moved out to be returned,
+ * the last element is moved into the root and then bubbled down until
+ * neither child is smaller than it.
  */
 DataPoint PQHeap::dequeue() {
     if (isEmpty())
         error("Cannot dequeue an empty pqueue");
-    DataPoint dequeuingValue = peek();
-    int parentSpot = 0;
-    int childSpot = 0;
-    int bubbler = _numFilled - 1;
-    _elements[parentSpot] = _elements[bubbler];
-    while (getLeftChildIndex(childSpot) != -1) {
-        if (_elements[parentSpot].priority > _elements[getLeftChildIndex(parentSpot)].priority
-            || _elements[parentSpot].priority > _elements[getRightChildIndex(parentSpot)].priority) {
-            childSpot = getSmallerChildIndex(parentSpot);
-            _elements[parentSpot] = _elements[childSpot];
-            _elements[childSpot] = _elements[bubbler];
-            parentSpot = childSpot;
-        }
-    }
+    DataPoint dequeuingValue = std::move(_elements[0]);
     _numFilled --;
-//    DataPoint* newElements = new DataPoint[_numAllocated];
-//    for (int i = 0; i < _numFilled; i++) {
-//        // Copy _elements into newElements
-//        newElements[i] = _elements[i];
-//    }
-//    delete [] _elements;
-//    _elements = newElements;
+    PQ_COUNT(_stats.moves++);
+    if (_numFilled > 0) {
+        _elements[0] = std::move(_elements[_numFilled]);
+        PQ_COUNT(_stats.moves++);
+        bubbleDown(0);
+    }
     return dequeuingValue;
 }
 
+/*
+ * Finds the k smallest elements by walking the heap from the root with a
+ * second, small heap of candidate slots: the next smallest element is
+ * always the best candidate, and taking it makes its children candidates.
+ * The slots taken form a subtree that includes the root. They are refilled
+ * in decreasing index order, each with the current last element bubbled
+ * down, so every hole is filled only after all of the holes below it.
+ */
+void PQHeap::dequeueMany(int k, Vector<DataPoint>& out) {
+    if (k < 0)
+        error("Cannot dequeue a negative number of elements");
+    k = min(k, _numFilled);
+    if (k == 0)
+        return;
+
+    vector<pair<int, int>> candidates = { { _elements[0].priority, 0 } };
+    vector<int> holes;
+    holes.reserve(k);
+    while ((int) holes.size() < k) {
+        pop_heap(candidates.begin(), candidates.end(), greater<pair<int, int>>());
+        int spot = candidates.back().second;
+        candidates.pop_back();
+        out.add(std::move(_elements[spot]));
+        PQ_COUNT(_stats.moves++);
+        holes.push_back(spot);
+        for (int child = 2 * spot + 1; child <= 2 * spot + 2 && child < _numFilled; child++) {
+            candidates.push_back({ _elements[child].priority, child });
+            push_heap(candidates.begin(), candidates.end(), greater<pair<int, int>>());
+        }
+    }
+
+    sort(holes.begin(), holes.end(), greater<int>());
+    for (int hole : holes) {
+        _numFilled --;
+        if (hole != _numFilled) {
+            fillHole(hole, std::move(_elements[_numFilled]));
+        }
+    }
+}
+
 /*
  * Returns that the size of the heap is 0 to indicate an empty heap.
  */
@@ -112,6 +216,14 @@ int PQHeap::size() const {
     return _numFilled;
 }
 
+PQStats PQHeap::stats() const {
+    return _stats;
+}
+
+void PQHeap::resetStats() {
+    _stats = PQStats();
+}
+
 /*
  * _numFilled is made equal to 0 to clear the items in the heap.
  */
@@ -145,16 +257,102 @@ void PQHeap::validateInternalState() {
      * in expected decreasing sorted order. Use error to report this problem.
      */
     for (int i = 0; i < size(); i++) {
-        if (_elements[i].priority > _elements[getLeftChildIndex(i)].priority ||
-                _elements[i].priority > _elements[getRightChildIndex(i)].priority)
+        int left = getLeftChildIndex(i);
+        int right = getRightChildIndex(i);
+        if ((left != -1 && _elements[i].priority > _elements[left].priority) ||
+                (right != -1 && _elements[i].priority > _elements[right].priority))
             error("Array elements out of order at index " + integerToString(i));
     }
 }
 
+/* Swaps the element at parentSpot with its smaller child for as long as
+ * that child has a smaller priority, restoring the heap property below
+ * parentSpot. Assumes both subtrees of parentSpot are already heaps.
+ */
+void PQHeap::bubbleDown(int parentSpot) {
+    PQ_COUNT(int depth = 0);
+    while (getLeftChildIndex(parentSpot) != -1) {
+        int childSpot = getSmallerChildIndex(parentSpot);
+        PQ_COUNT(_stats.comparisons += (getRightChildIndex(parentSpot) != -1) + 1);
+        if (_elements[parentSpot].priority <= _elements[childSpot].priority)
+            break;
+        swap(_elements[parentSpot], _elements[childSpot]);
+        PQ_COUNT(_stats.moves += 3);
+        PQ_COUNT(depth++);
+        parentSpot = childSpot;
+    }
+    PQ_COUNT(_stats.recordSift(depth));
+}
+
+/* Fills the hole at holeSpot with elem. The last element of a heap almost
+ * always belongs near the bottom, so rather than comparing elem against
+ * the children on the way down, the smaller child is moved up into the
+ * hole all the way to a leaf, and elem is then moved up from there to its
+ * spot, which is usually only a level or two. Each element is moved once,
+ * and each level costs one comparison instead of two.
+ */
+void PQHeap::fillHole(int holeSpot, DataPoint&& elem) {
+    int topSpot = holeSpot;
+    PQ_COUNT(int down = 0);
+    for (int childSpot = 2 * holeSpot + 1; childSpot < _numFilled; childSpot = 2 * holeSpot + 1) {
+        PQ_COUNT(_stats.comparisons += (childSpot + 1 < _numFilled));
+        if (childSpot + 1 < _numFilled && _elements[childSpot + 1].priority < _elements[childSpot].priority)
+            childSpot++;
+        _elements[holeSpot] = std::move(_elements[childSpot]);
+        holeSpot = childSpot;
+        PQ_COUNT(down++);
+    }
+    PQ_COUNT(int up = 0);
+    while (holeSpot != topSpot && elem.priority < _elements[(holeSpot - 1) / 2].priority) {
+        int parentSpot = (holeSpot - 1) / 2;
+        _elements[holeSpot] = std::move(_elements[parentSpot]);
+        holeSpot = parentSpot;
+        PQ_COUNT(up++);
+    }
+    _elements[holeSpot] = std::move(elem);
+    PQ_COUNT(_stats.comparisons += up + (holeSpot != topSpot));
+    PQ_COUNT(_stats.moves += down + up + 1);
+    PQ_COUNT(_stats.recordSift(down - up));
+}
+
+/* Rearranges the filled portion of the array into a heap by bubbling
+ * down every parent, starting with the last one. Most of the parents are
+ * near the bottom of the tree where bubbling down is short, so the total
+ * work is O(N).
+ */
+void PQHeap::heapify() {
+    for (int i = getParentIndex(_numFilled - 1); i >= 0; i--) {
+        bubbleDown(i);
+    }
+}
+
+/* Makes sure the array has room for at least numNeeded elements, doubling
+ * its size (or more, for big batches) and moving the elements over.
+ */
+void PQHeap::ensureCapacity(int numNeeded) {
+    if (numNeeded < _numAllocated)
+        return;
+    int newAllocated = max(_numAllocated * 2, numNeeded + 1);
+    // Create array of the new size
+    DataPoint* newElements = allocateElements(_resource, newAllocated);
+    for (int i = 0; i < _numFilled; i++) {
+        // Move _elements into newElements
+        newElements[i] = std::move(_elements[i]);
+    }
+    PQ_COUNT(_stats.reallocations++);
+    PQ_COUNT(_stats.bytesAllocated += newAllocated * (long long) sizeof(DataPoint));
+    PQ_COUNT(_stats.moves += _numFilled);
+    freeElements(_resource, _elements, _numAllocated);
+    _elements = newElements;
+    _numAllocated = newAllocated;
+}
+
 /* Calculates the index of the smaller child of the parent with the
  * provided parent index.
  */
 int PQHeap::getSmallerChildIndex(int parentIndex) {
+    if (getRightChildIndex(parentIndex) == -1)
+        return getLeftChildIndex(parentIndex);
     if (_elements[getLeftChildIndex(parentIndex)].priority < _elements[getRightChildIndex(parentIndex)].priority)
         return getLeftChildIndex(parentIndex);
     else {
@@ -205,6 +403,134 @@ STUDENT_TEST("enqueue tests") {
     EXPECT_EQUAL(pq.size(), 9);
 }
 
+STUDENT_TEST("Bulk constructor builds a valid heap that dequeues in order") {
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    PQHeap pq(input);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.size(), 9);
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+
+    PQHeap empty(Vector<DataPoint>{});
+    EXPECT(empty.isEmpty());
+    EXPECT_ERROR(empty.peek());
+}
+
+STUDENT_TEST("enqueueAll into empty and non-empty heaps") {
+    PQHeap pq;
+    Vector<DataPoint> batch;
+    for (int i = 0; i < 100; i++) {
+        batch.add({ "", randomInteger(-50, 50) });
+    }
+    pq.enqueueAll(batch);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.size(), 100);
+
+    // small batch goes through regular enqueue, big one is heapified
+    pq.enqueueAll({ { "min", -1000 }, { "max", 1000 } });
+    pq.validateInternalState();
+    pq.enqueueAll(batch);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.size(), 202);
+
+    DataPoint expected = { "min", -1000 };
+    EXPECT_EQUAL(pq.dequeue(), expected);
+    int last = -1000;
+    while (pq.size() > 1) {
+        DataPoint cur = pq.dequeue();
+        EXPECT(cur.priority >= last);
+        last = cur.priority;
+    }
+    expected = { "max", 1000 };
+    EXPECT_EQUAL(pq.dequeue(), expected);
+}
+
+STUDENT_TEST("emplace and rvalue enqueue keep labels with their priorities") {
+    PQHeap pq;
+    pq.emplace("three", 3);
+    DataPoint one = { "one", 1 };
+    pq.enqueue(one);
+    pq.enqueue(DataPoint{ "two", 2 });
+    pq.validateInternalState();
+    EXPECT_EQUAL(one.label, "one");
+
+    Vector<DataPoint> expected = { { "one", 1 }, { "two", 2 }, { "three", 3 } };
+    for (const DataPoint& dp : expected) {
+        EXPECT_EQUAL(pq.dequeue(), dp);
+    }
+}
+
+STUDENT_TEST("Steady-state enqueue/dequeue cycle does no allocations") {
+    PQHeap pq;
+    int n = 1000;
+    for (int i = 0; i < n; i++) {
+        pq.emplace("a label too long for the small string buffer " + integerToString(i), randomInteger(0, n));
+    }
+    long before = numHeapAllocations();
+    for (int i = 0; i < 10 * n; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority += randomInteger(0, n);
+        pq.enqueue(std::move(cur));
+    }
+    long after = numHeapAllocations();
+    EXPECT_EQUAL(after - before, 0);
+    EXPECT_EQUAL(pq.size(), n);
+    pq.validateInternalState();
+
+    // peek hands back a copy, which does allocate for a long label
+    DataPoint front = pq.peek();
+    EXPECT(numHeapAllocations() > after);
+}
+
+STUDENT_TEST("dequeueMany matches repeated dequeue") {
+    for (int n : { 0, 1, 2, 9, 100, 1000 }) {
+        for (int k : { 0, 1, 3, 64, 500, 2000 }) {
+            Vector<DataPoint> input;
+            for (int i = 0; i < n; i++) {
+                input.add({ integerToString(i), randomInteger(0, n / 4) });
+            }
+            PQHeap batched(input);
+            PQHeap single(input);
+            Vector<DataPoint> out = { { "already there", -1 } };
+            batched.dequeueMany(k, out);
+            batched.validateInternalState();
+            int taken = min(k, n);
+            EXPECT_EQUAL(out.size(), taken + 1);
+            EXPECT_EQUAL(batched.size(), n - taken);
+            for (int i = 1; i <= taken; i++) {
+                EXPECT_EQUAL(out[i].priority, single.dequeue().priority);
+            }
+            while (!batched.isEmpty()) {
+                EXPECT_EQUAL(batched.dequeue().priority, single.dequeue().priority);
+            }
+        }
+    }
+    PQHeap pq;
+    Vector<DataPoint> out;
+    EXPECT_ERROR(pq.dequeueMany(-1, out));
+}
+
+STUDENT_TEST("enqueueMany builds the same heap as enqueueAll") {
+    Vector<DataPoint> batch;
+    for (int i = 0; i < 100; i++) {
+        batch.add({ integerToString(i), randomInteger(-50, 50) });
+    }
+    PQHeap all;
+    PQHeap many;
+    all.enqueueAll(batch);
+    many.enqueueMany(batch);
+    many.validateInternalState();
+    while (!all.isEmpty()) {
+        EXPECT_EQUAL(many.dequeue(), all.dequeue());
+    }
+    EXPECT(many.isEmpty());
+}
+
 /* * * * * Provided Tests Below This Point * * * * */
 
 PROVIDED_TEST("PQHeap example from writeup, validate each step") {
@@ -244,3 +570,61 @@ PROVIDED_TEST("PQHeap timing test, fillQueue and emptyQueue") {
     TIME_OPERATION(40000, emptyQueue(pq, 40000));
 }
 
+static void bulkFillQueue(PQHeap& pq, const Vector<DataPoint>& input) {
+    pq.clear(); // start with empty queue
+    pq.enqueueAll(input);
+}
+
+static void oneByOneFillQueue(PQHeap& pq, const Vector<DataPoint>& input) {
+    pq.clear(); // start with empty queue
+    for (const DataPoint& elem : input) {
+        pq.enqueue(elem);
+    }
+}
+
+static void drainOneByOne(PQHeap& pq, int batchSize) {
+    while (!pq.isEmpty()) {
+        for (int i = 0; i < batchSize && !pq.isEmpty(); i++) {
+            pq.dequeue();
+        }
+    }
+}
+
+static void drainInBatches(PQHeap& pq, int batchSize) {
+    Vector<DataPoint> out;
+    while (!pq.isEmpty()) {
+        out.clear();
+        pq.dequeueMany(batchSize, out);
+    }
+}
+
+STUDENT_TEST("PQHeap timing test, draining with dequeue versus dequeueMany") {
+    int n = 1000000;
+    Vector<DataPoint> input;
+    for (int i = 0; i < n; i++) {
+        input.add({ "", randomInteger(1, n) });
+    }
+    for (int batchSize = 64; batchSize <= 1024; batchSize *= 4) {
+        PQHeap pq;
+        pq.enqueueMany(input);
+        TIME_OPERATION(batchSize, drainOneByOne(pq, batchSize));
+        pq.enqueueMany(input);
+        TIME_OPERATION(batchSize, drainInBatches(pq, batchSize));
+    }
+}
+
+STUDENT_TEST("PQHeap timing test, fillQueue versus bulk enqueueAll") {
+    for (int n = 100000; n <= 1000000; n *= 10) {
+        PQHeap pq;
+        Vector<DataPoint> ascending;
+        Vector<DataPoint> shuffled;
+        for (int i = 0; i < n; i++) {
+            ascending.add({ "", i });
+            shuffled.add({ "", randomInteger(1, n) });
+        }
+        TIME_OPERATION(n, fillQueue(pq, n));
+        TIME_OPERATION(n, bulkFillQueue(pq, ascending));
+        TIME_OPERATION(n, oneByOneFillQueue(pq, shuffled));
+        TIME_OPERATION(n, bulkFillQueue(pq, shuffled));
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include "pqstats.h"
+#include "testing/MemoryDiagnostics.h"
+#include <memory_resource>
+#include <string>
+
+/**
+ * Priority queue type implemented using a binary min-heap stored
+ * in a dynamic array. The frontmost element (the one with the
+ * smallest priority value) is always at index 0.
+ */
+class PQHeap {
+public:
+    /**
+     * Creates a new, empty priority queue. Its element array is allocated
+     * from the given memory resource, such as a PQArena's, or else with
+     * the default resource, which uses new and delete.
+     */
+    explicit PQHeap(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * Creates a priority queue holding all of the given elements. The
+     * heap is built bottom-up in O(N) time, which is much faster than
+     * enqueueing the elements one at a time.
+     */
+    explicit PQHeap(Vector<DataPoint> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQHeap();
+
+    /**
+     * Adds a new element into the queue. This operation runs in
+     * time O(log N), where N is the number of elements in the queue.
+     * The rvalue version moves the element in without copying its label.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Adds a new element with the given label and priority into the queue.
+     */
+    void emplace(std::string label, int priority);
+
+    /**
+     * Adds all of the given elements into the queue. Large batches are
+     * appended and heapified in O(N) time in one pass.
+     */
+    void enqueueAll(const Vector<DataPoint>& elements);
+
+    /**
+     * Same as enqueueAll. The name matches PQSortedArray, so code that
+     * takes either queue can use one batch API.
+     */
+    void enqueueMany(const Vector<DataPoint>& elements);
+
+    /**
+     * Removes and returns the element that is frontmost in this
+     * priority queue. The frontmost element is the one with the
+     * minimum priority value. The element is moved out of the array
+     * rather than copied.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Removes the k frontmost elements and adds them to the end of out,
+     * in the order dequeue would have returned them. If the queue has
+     * fewer than k elements, all of them are removed.
+     *
+     * The k elements are found with a small heap of candidate slots in
+     * O(k log k), and the holes they leave are then refilled from the
+     * bottom up. Holes deep in the tree need only a short bubble down,
+     * so this beats k calls to dequeue.
+     *
+     * If k is negative, this function calls error().
+     */
+    void dequeueMany(int k, Vector<DataPoint>& out);
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the priority of the frontmost element, without copying it.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekPriority() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Returns the counts of the work this queue has done since it was
+     * created or since the last resetStats(). They are only counted in
+     * builds with PQ_ENABLE_STATS defined, and are zero otherwise.
+     */
+    PQStats stats() const;
+
+    /**
+     * Sets all of the counts returned by stats() back to zero.
+     */
+    void resetStats();
+
+    /**
+     * Confirms the internal state of the member variables appears
+     * valid and calls error() if the heap property is violated.
+     */
+    void validateInternalState();
+
+    /*
+     * Index helpers for navigating the heap array. Each returns -1
+     * if the requested index is outside the filled portion.
+     */
+    int getParentIndex(int curIndex);
+    int getLeftChildIndex(int curIndex);
+    int getRightChildIndex(int curIndex);
+
+private:
+    DataPoint* _elements;   // dynamic array
+    std::pmr::memory_resource* _resource;   // where _elements comes from
+    int _numAllocated;      // number of slots allocated in array
+    int _numFilled;         // number of slots filled in array
+    PQStats _stats;         // work done, for stats()
+
+    int getSmallerChildIndex(int parentIndex);
+    void bubbleDown(int parentSpot);
+    void fillHole(int holeSpot, DataPoint&& elem);
+    void heapify();
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQHeap(const PQHeap &) = delete;
+    void operator=(const PQHeap &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQHeap);
+};
@@ -0,0 +1,352 @@
+/* A binary heap with stable handles and a position map, for changing the
+ * priority of queued elements in place.
+ */
+#include "pqindexedheap.h"
+#include "pqheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static const int INITIAL_CAPACITY = 10;
+
+PQIndexedHeap::PQIndexedHeap() {
+    _numAllocated = INITIAL_CAPACITY;
+    _elements = new DataPoint[_numAllocated];
+    _handleAt = new int[_numAllocated];
+    _positionOf = new int[_numAllocated];
+    _freeHandles = new int[_numAllocated];
+    _numFilled = 0;
+    _numFree = 0;
+    _numHandles = 0;
+}
+
+PQIndexedHeap::~PQIndexedHeap() {
+    delete[] _elements;
+    delete[] _handleAt;
+    delete[] _positionOf;
+    delete[] _freeHandles;
+}
+
+int PQIndexedHeap::enqueue(const DataPoint& elem) {
+    return enqueue(DataPoint(elem));
+}
+
+/*
+ * Takes a recycled handle if there is one, and otherwise a brand new one.
+ */
+int PQIndexedHeap::enqueue(DataPoint&& elem) {
+    ensureCapacity(_numFilled + 1);
+    int handle = _numFree > 0 ? _freeHandles[--_numFree] : _numHandles++;
+    place(std::move(elem), handle, _numFilled);
+    _numFilled++;
+    bubbleUp(_numFilled - 1);
+    return handle;
+}
+
+DataPoint PQIndexedHeap::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    return remove(_handleAt[0]);
+}
+
+DataPoint PQIndexedHeap::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _elements[0];
+}
+
+int PQIndexedHeap::peekHandle() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _handleAt[0];
+}
+
+bool PQIndexedHeap::contains(int handle) const {
+    return handle >= 0 && handle < _numHandles && _positionOf[handle] != -1;
+}
+
+DataPoint PQIndexedHeap::get(int handle) const {
+    checkHandle(handle);
+    return _elements[_positionOf[handle]];
+}
+
+/*
+ * Only one of the two sifts can move the element: up if the priority went
+ * down, down if it went up.
+ */
+void PQIndexedHeap::changePriority(int handle, int newPriority) {
+    checkHandle(handle);
+    int index = _positionOf[handle];
+    int oldPriority = _elements[index].priority;
+    _elements[index].priority = newPriority;
+    if (newPriority < oldPriority) {
+        bubbleUp(index);
+    } else {
+        bubbleDown(index);
+    }
+}
+
+/*
+ * The last element is moved into the hole left by the removed one. It may
+ * belong further up or further down from there, so both sifts are tried.
+ */
+DataPoint PQIndexedHeap::remove(int handle) {
+    checkHandle(handle);
+    int index = _positionOf[handle];
+    DataPoint removed = std::move(_elements[index]);
+    _positionOf[handle] = -1;
+    _freeHandles[_numFree++] = handle;
+    _numFilled--;
+    if (index < _numFilled) {
+        int lastHandle = _handleAt[_numFilled];
+        place(std::move(_elements[_numFilled]), lastHandle, index);
+        bubbleUp(index);
+        bubbleDown(_positionOf[lastHandle]);
+    }
+    return removed;
+}
+
+bool PQIndexedHeap::isEmpty() const {
+    return size() == 0;
+}
+
+int PQIndexedHeap::size() const {
+    return _numFilled;
+}
+
+void PQIndexedHeap::clear() {
+    for (int i = 0; i < _numHandles; i++) {
+        _positionOf[i] = -1;
+    }
+    _numFilled = 0;
+    _numFree = 0;
+    _numHandles = 0;
+}
+
+void PQIndexedHeap::validateInternalState() {
+    if (_numFilled > _numAllocated) error("Too many elements in not enough space!");
+    if (_numFilled + _numFree != _numHandles) error("Handles leaked or double counted!");
+
+    for (int i = 0; i < size(); i++) {
+        if (i > 0 && _elements[(i - 1) / 2].priority > _elements[i].priority)
+            error("Array elements out of order at index " + integerToString(i));
+        int handle = _handleAt[i];
+        if (handle < 0 || handle >= _numHandles || _positionOf[handle] != i)
+            error("Position map disagrees with heap at index " + integerToString(i));
+    }
+    for (int i = 0; i < _numFree; i++) {
+        int handle = _freeHandles[i];
+        if (handle < 0 || handle >= _numHandles || _positionOf[handle] != -1)
+            error("Free handle " + integerToString(handle) + " is still mapped to the heap");
+    }
+}
+
+void PQIndexedHeap::checkHandle(int handle) const {
+    if (!contains(handle))
+        error("Handle " + integerToString(handle) + " is not in the pqueue");
+}
+
+/*
+ * Moves the element into heap index and records where its handle now is.
+ */
+void PQIndexedHeap::place(DataPoint&& elem, int handle, int index) {
+    _elements[index] = std::move(elem);
+    _handleAt[index] = handle;
+    _positionOf[handle] = index;
+}
+
+/*
+ * Slides larger parents down into the hole, updating their positions,
+ * until the element fits.
+ */
+void PQIndexedHeap::bubbleUp(int index) {
+    DataPoint elem = std::move(_elements[index]);
+    int handle = _handleAt[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (_elements[parent].priority <= elem.priority)
+            break;
+        place(std::move(_elements[parent]), _handleAt[parent], index);
+        index = parent;
+    }
+    place(std::move(elem), handle, index);
+}
+
+/*
+ * Slides the smaller child up into the hole, updating its position, until
+ * the element fits.
+ */
+void PQIndexedHeap::bubbleDown(int index) {
+    DataPoint elem = std::move(_elements[index]);
+    int handle = _handleAt[index];
+    while (2 * index + 1 < _numFilled) {
+        int child = 2 * index + 1;
+        if (child + 1 < _numFilled && _elements[child + 1].priority < _elements[child].priority)
+            child++;
+        if (elem.priority <= _elements[child].priority)
+            break;
+        place(std::move(_elements[child]), _handleAt[child], index);
+        index = child;
+    }
+    place(std::move(elem), handle, index);
+}
+
+/*
+ * Doubles all four arrays together. There are never more handles than
+ * elements that have been in the heap at once, so the handle arrays can
+ * share the capacity of the element array.
+ */
+void PQIndexedHeap::ensureCapacity(int numNeeded) {
+    if (numNeeded <= _numAllocated)
+        return;
+    int newAllocated = max(_numAllocated * 2, numNeeded);
+    DataPoint* newElements = new DataPoint[newAllocated];
+    int* newHandleAt = new int[newAllocated];
+    int* newPositionOf = new int[newAllocated];
+    int* newFreeHandles = new int[newAllocated];
+    for (int i = 0; i < _numFilled; i++) {
+        newElements[i] = std::move(_elements[i]);
+        newHandleAt[i] = _handleAt[i];
+    }
+    for (int i = 0; i < _numHandles; i++) {
+        newPositionOf[i] = _positionOf[i];
+    }
+    for (int i = 0; i < _numFree; i++) {
+        newFreeHandles[i] = _freeHandles[i];
+    }
+    delete[] _elements;
+    delete[] _handleAt;
+    delete[] _positionOf;
+    delete[] _freeHandles;
+    _elements = newElements;
+    _handleAt = newHandleAt;
+    _positionOf = newPositionOf;
+    _freeHandles = newFreeHandles;
+    _numAllocated = newAllocated;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQIndexedHeap example from writeup, validate each step") {
+    PQIndexedHeap pq;
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+
+    pq.validateInternalState();
+    for (auto dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+    EXPECT_ERROR(pq.peekHandle());
+}
+
+STUDENT_TEST("PQIndexedHeap changePriority and remove through handles") {
+    PQIndexedHeap pq;
+    int a = pq.enqueue({ "a", 10 });
+    int b = pq.enqueue({ "b", 20 });
+    int c = pq.enqueue({ "c", 30 });
+    int d = pq.enqueue({ "d", 40 });
+
+    pq.changePriority(d, 5);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.peekHandle(), d);
+    DataPoint expected = { "d", 5 };
+    EXPECT_EQUAL(pq.get(d), expected);
+
+    pq.changePriority(d, 50);
+    pq.validateInternalState();
+    EXPECT_EQUAL(pq.peekHandle(), a);
+
+    expected = { "b", 20 };
+    EXPECT_EQUAL(pq.remove(b), expected);
+    pq.validateInternalState();
+    EXPECT(!pq.contains(b));
+    EXPECT_ERROR(pq.remove(b));
+    EXPECT_ERROR(pq.changePriority(b, 1));
+    EXPECT_ERROR(pq.get(-1));
+    EXPECT_ERROR(pq.get(100));
+
+    EXPECT_EQUAL(pq.dequeue().label, "a");
+    EXPECT_EQUAL(pq.dequeue().label, "c");
+    EXPECT_EQUAL(pq.dequeue().label, "d");
+    EXPECT(pq.isEmpty());
+    EXPECT(!pq.contains(a));
+    EXPECT(!pq.contains(c));
+}
+
+STUDENT_TEST("PQIndexedHeap random updates keep the position map consistent") {
+    PQIndexedHeap pq;
+    Vector<int> live;
+    for (int step = 0; step < 5000; step++) {
+        int choice = randomInteger(0, 3);
+        if (choice == 0 || live.isEmpty()) {
+            live.add(pq.enqueue({ "", randomInteger(-1000, 1000) }));
+        } else if (choice == 1) {
+            pq.changePriority(live[randomInteger(0, live.size() - 1)], randomInteger(-1000, 1000));
+        } else if (choice == 2) {
+            int index = randomInteger(0, live.size() - 1);
+            pq.remove(live[index]);
+            live.remove(index);
+        } else {
+            int handle = pq.peekHandle();
+            DataPoint front = pq.peek();
+            EXPECT_EQUAL(pq.dequeue(), front);
+            for (int i = 0; i < live.size(); i++) {
+                if (live[i] == handle) {
+                    live.remove(i);
+                    break;
+                }
+            }
+        }
+        if (step % 100 == 0) pq.validateInternalState();
+        EXPECT_EQUAL(pq.size(), live.size());
+    }
+    pq.validateInternalState();
+    int last = -1000;
+    while (!pq.isEmpty()) {
+        int cur = pq.dequeue().priority;
+        EXPECT(cur >= last);
+        last = cur;
+    }
+}
+
+static void changeAllPriorities(PQIndexedHeap& pq, const Vector<int>& handles, const Vector<int>& newPriorities) {
+    for (int i = 0; i < handles.size(); i++) {
+        pq.changePriority(handles[i], newPriorities[i]);
+    }
+}
+
+static void enqueueDuplicates(PQHeap& pq, const Vector<int>& newPriorities) {
+    for (int priority : newPriorities) {
+        pq.enqueue({ "", priority });
+    }
+}
+
+STUDENT_TEST("PQIndexedHeap timing test, changePriority versus enqueueing duplicates") {
+    int n = 200000;
+    PQIndexedHeap indexed;
+    PQHeap plain;
+    Vector<int> handles;
+    Vector<int> newPriorities;
+    for (int i = 0; i < n; i++) {
+        int priority = randomInteger(n, 2 * n);
+        handles.add(indexed.enqueue({ "", priority }));
+        plain.enqueue({ "", priority });
+        newPriorities.add(randomInteger(0, n));
+    }
+    TIME_OPERATION(n, changeAllPriorities(indexed, handles, newPriorities));
+    TIME_OPERATION(n, enqueueDuplicates(plain, newPriorities));
+    EXPECT_EQUAL(indexed.size(), n);
+    EXPECT_EQUAL(plain.size(), 2 * n);
+    indexed.validateInternalState();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "datapoint.h"
+#include "testing/MemoryDiagnostics.h"
+#include <string>
+
+/**
+ * Priority queue type implemented using a binary min-heap, where every
+ * element has a handle that stays the same while the element is queued.
+ * A position map from handle to heap index is kept up to date as elements
+ * bubble up and down, so an element's priority can be changed, or the
+ * element removed, in O(log N) time without searching for it.
+ *
+ * Handles are small non-negative ints. Once an element leaves the queue,
+ * its handle is no longer valid and may be handed out again by a later
+ * enqueue.
+ */
+class PQIndexedHeap {
+public:
+    /**
+     * Creates a new, empty priority queue.
+     */
+    PQIndexedHeap();
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQIndexedHeap();
+
+    /**
+     * Adds a new element into the queue and returns its handle. This
+     * operation runs in time O(log N).
+     */
+    int enqueue(const DataPoint& element);
+    int enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the handle of the frontmost element.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekHandle() const;
+
+    /**
+     * Returns whether handle refers to an element currently in the queue.
+     */
+    bool contains(int handle) const;
+
+    /**
+     * Returns the element with the given handle.
+     *
+     * If the handle isn't in the queue, this function calls error().
+     */
+    DataPoint get(int handle) const;
+
+    /**
+     * Changes the priority of the element with the given handle and moves
+     * it up or down the heap to match, in O(log N) time.
+     *
+     * If the handle isn't in the queue, this function calls error().
+     */
+    void changePriority(int handle, int newPriority);
+
+    /**
+     * Removes and returns the element with the given handle, in O(log N)
+     * time.
+     *
+     * If the handle isn't in the queue, this function calls error().
+     */
+    DataPoint remove(int handle);
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue. All handles become
+     * invalid.
+     */
+    void clear();
+
+    /**
+     * Confirms the heap property holds and that the position map agrees
+     * with the heap array. Calls error() if problems are found.
+     */
+    void validateInternalState();
+
+private:
+    DataPoint* _elements;   // heap-ordered elements
+    int* _handleAt;         // handle of the element at each heap index
+    int* _positionOf;       // heap index of each handle, -1 if not queued
+    int* _freeHandles;      // stack of handles available for reuse
+    int _numAllocated;      // number of slots allocated in each array
+    int _numFilled;         // number of elements in the heap
+    int _numFree;           // number of entries on the _freeHandles stack
+    int _numHandles;        // handles handed out so far, live or free
+
+    void checkHandle(int handle) const;
+    void place(DataPoint&& element, int handle, int index);
+    void bubbleUp(int index);
+    void bubbleDown(int index);
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQIndexedHeap(const PQIndexedHeap &) = delete;
+    void operator=(const PQIndexedHeap &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQIndexedHeap);
+};
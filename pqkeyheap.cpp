@@ -0,0 +1,372 @@
+/* A binary heap that orders small (priority, slot) keys and keeps the labels
+ * of its DataPoints in a side array that the sifts never touch.
+ */
+#include "pqkeyheap.h"
+#include "pqheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static const int INITIAL_CAPACITY = 10;
+
+/*
+ * The three arrays always share the same capacity: there are never more
+ * label slots in use than keys that have been in the heap at once, and
+ * never more free slots than slots handed out.
+ */
+PQKeyHeap::PQKeyHeap() {
+    _numAllocated = INITIAL_CAPACITY;
+    _keys = new HeapKey[_numAllocated];
+    _pool = nullptr;
+    _labels = new string[_numAllocated];
+    _freeSlots = new uint32_t[_numAllocated];
+    _numFilled = 0;
+    _numFree = 0;
+    _numSlotsUsed = 0;
+}
+
+/*
+ * In interned mode only the keys are allocated; the pool keeps the labels
+ * and there are no slots to recycle.
+ */
+PQKeyHeap::PQKeyHeap(LabelPool& pool) {
+    _numAllocated = INITIAL_CAPACITY;
+    _keys = new HeapKey[_numAllocated];
+    _pool = &pool;
+    _labels = nullptr;
+    _freeSlots = nullptr;
+    _numFilled = 0;
+    _numFree = 0;
+    _numSlotsUsed = 0;
+}
+
+PQKeyHeap::~PQKeyHeap() {
+    delete[] _keys;
+    delete[] _labels;
+    delete[] _freeSlots;
+}
+
+/*
+ * The label is parked in a free slot (or a brand new one), or interned in
+ * the pool, and only the key goes into the heap.
+ */
+void PQKeyHeap::enqueue(DataPoint&& elem) {
+    if (_pool != nullptr) {
+        add({ elem.priority, _pool->intern(elem.label) });
+        return;
+    }
+    ensureCapacity(_numFilled + 1);
+    uint32_t slot;
+    if (_numFree > 0) {
+        slot = _freeSlots[--_numFree];
+    } else {
+        slot = _numSlotsUsed++;
+    }
+    _labels[slot] = std::move(elem.label);
+    add({ elem.priority, slot });
+}
+
+void PQKeyHeap::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+void PQKeyHeap::emplace(string label, int priority) {
+    enqueue(DataPoint{ std::move(label), priority });
+}
+
+void PQKeyHeap::enqueueInterned(const InternedPoint& elem) {
+    if (_pool == nullptr)
+        error("PQKeyHeap is not in interned mode");
+    add({ elem.priority, elem.labelId });
+}
+
+/*
+ * The DataPoint is materialized from the root key and its label. Outside
+ * interned mode the label slot is recycled for a later enqueue.
+ */
+DataPoint PQKeyHeap::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    HeapKey root = removeRoot();
+    if (_pool != nullptr) {
+        return { string(_pool->label(root.slot)), root.priority };
+    }
+    _freeSlots[_numFree++] = root.slot;
+    return { std::move(_labels[root.slot]), root.priority };
+}
+
+InternedPoint PQKeyHeap::dequeueInterned() {
+    if (_pool == nullptr)
+        error("PQKeyHeap is not in interned mode");
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    HeapKey root = removeRoot();
+    return { root.slot, root.priority };
+}
+
+DataPoint PQKeyHeap::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    if (_pool != nullptr) {
+        return { string(_pool->label(_keys[0].slot)), _keys[0].priority };
+    }
+    return { _labels[_keys[0].slot], _keys[0].priority };
+}
+
+int PQKeyHeap::peekPriority() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _keys[0].priority;
+}
+
+bool PQKeyHeap::isEmpty() const {
+    return size() == 0;
+}
+
+int PQKeyHeap::size() const {
+    return _numFilled;
+}
+
+/*
+ * Forgets all keys and label slots. The labels left in the side array are
+ * overwritten when their slots are handed out again.
+ */
+void PQKeyHeap::clear() {
+    _numFilled = 0;
+    _numFree = 0;
+    _numSlotsUsed = 0;
+}
+
+void PQKeyHeap::validateInternalState() {
+    if (_numFilled > _numAllocated) error("Too many elements in not enough space!");
+    if (_pool != nullptr) {
+        for (int i = 0; i < size(); i++) {
+            if (i > 0 && _keys[(i - 1) / 2].priority > _keys[i].priority)
+                error("Array elements out of order at index " + integerToString(i));
+            if ((int) _keys[i].slot >= _pool->size())
+                error("Bad label id at index " + integerToString(i));
+        }
+        return;
+    }
+    if (_numFilled + _numFree != _numSlotsUsed) error("Label slots leaked or double counted!");
+
+    Vector<int> seen(_numSlotsUsed, 0);
+    for (int i = 0; i < _numFree; i++) {
+        seen[_freeSlots[i]]++;
+    }
+    for (int i = 0; i < size(); i++) {
+        if (i > 0 && _keys[(i - 1) / 2].priority > _keys[i].priority)
+            error("Array elements out of order at index " + integerToString(i));
+        uint32_t slot = _keys[i].slot;
+        if ((int) slot >= _numSlotsUsed || seen[slot])
+            error("Bad label slot at index " + integerToString(i));
+        seen[slot]++;
+    }
+}
+
+/*
+ * Appends the key and bubbles it up into place.
+ */
+void PQKeyHeap::add(HeapKey key) {
+    ensureCapacity(_numFilled + 1);
+    _keys[_numFilled] = key;
+    _numFilled++;
+    bubbleUp(_numFilled - 1);
+}
+
+/*
+ * Takes the root key out and moves the last key into its place.
+ */
+PQKeyHeap::HeapKey PQKeyHeap::removeRoot() {
+    HeapKey root = _keys[0];
+    _numFilled--;
+    if (_numFilled > 0) {
+        _keys[0] = _keys[_numFilled];
+        bubbleDown(0);
+    }
+    return root;
+}
+
+/*
+ * Slides larger parents down into the hole until the key fits.
+ */
+void PQKeyHeap::bubbleUp(int index) {
+    HeapKey key = _keys[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (_keys[parent].priority <= key.priority)
+            break;
+        _keys[index] = _keys[parent];
+        index = parent;
+    }
+    _keys[index] = key;
+}
+
+/*
+ * Slides the smaller child up into the hole until the key fits.
+ */
+void PQKeyHeap::bubbleDown(int index) {
+    HeapKey key = _keys[index];
+    while (2 * index + 1 < _numFilled) {
+        int child = 2 * index + 1;
+        if (child + 1 < _numFilled && _keys[child + 1].priority < _keys[child].priority)
+            child++;
+        if (key.priority <= _keys[child].priority)
+            break;
+        _keys[index] = _keys[child];
+        index = child;
+    }
+    _keys[index] = key;
+}
+
+/*
+ * Doubles all three arrays together, or just the keys in interned mode.
+ * Labels are moved across, so growing does not copy any strings.
+ */
+void PQKeyHeap::ensureCapacity(int numNeeded) {
+    if (numNeeded <= _numAllocated)
+        return;
+    int newAllocated = max(_numAllocated * 2, numNeeded);
+    HeapKey* newKeys = new HeapKey[newAllocated];
+    for (int i = 0; i < _numFilled; i++) {
+        newKeys[i] = _keys[i];
+    }
+    delete[] _keys;
+    _keys = newKeys;
+    if (_pool == nullptr) {
+        string* newLabels = new string[newAllocated];
+        uint32_t* newFreeSlots = new uint32_t[newAllocated];
+        for (int i = 0; i < _numSlotsUsed; i++) {
+            newLabels[i] = std::move(_labels[i]);
+        }
+        for (int i = 0; i < _numFree; i++) {
+            newFreeSlots[i] = _freeSlots[i];
+        }
+        delete[] _labels;
+        delete[] _freeSlots;
+        _labels = newLabels;
+        _freeSlots = newFreeSlots;
+    }
+    _numAllocated = newAllocated;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQKeyHeap example from writeup, labels come back with their priorities") {
+    PQKeyHeap pq;
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    Vector<DataPoint> expected = {
+        { "T", 1 }, { "G", 2 }, { "B", 3 }, { "R", 4 }, { "A", 5 },
+        { "S", 6 }, { "K", 7 }, { "O", 8 }, { "V", 9 } };
+
+    pq.validateInternalState();
+    for (auto dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.size(), 9);
+    for (const DataPoint& dp : expected) {
+        EXPECT_EQUAL(pq.peek(), dp);
+        EXPECT_EQUAL(pq.peekPriority(), dp.priority);
+        EXPECT_EQUAL(pq.dequeue(), dp);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+    EXPECT_ERROR(pq.peekPriority());
+}
+
+STUDENT_TEST("PQKeyHeap recycles label slots across interleaved enqueue/dequeue") {
+    PQKeyHeap pq;
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 50; i++) {
+            int priority = randomInteger(-100, 100);
+            pq.enqueue({ "label" + integerToString(priority), priority });
+        }
+        pq.validateInternalState();
+        for (int i = 0; i < 30; i++) {
+            DataPoint cur = pq.dequeue();
+            EXPECT_EQUAL(cur.label, "label" + integerToString(cur.priority));
+        }
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.size(), 100);
+    pq.clear();
+    EXPECT(pq.isEmpty());
+    pq.validateInternalState();
+    pq.enqueue({ "again", 1 });
+    DataPoint expected = { "again", 1 };
+    EXPECT_EQUAL(pq.dequeue(), expected);
+}
+
+STUDENT_TEST("PQKeyHeap steady-state enqueue/dequeue cycle does no allocations") {
+    PQKeyHeap pq;
+    int n = 1000;
+    for (int i = 0; i < n; i++) {
+        pq.emplace("a label too long for the small string buffer " + integerToString(i), randomInteger(0, n));
+    }
+    long before = numHeapAllocations();
+    for (int i = 0; i < 10 * n; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority += randomInteger(0, n);
+        pq.enqueue(std::move(cur));
+    }
+    EXPECT_EQUAL(numHeapAllocations() - before, 0);
+    pq.validateInternalState();
+}
+
+STUDENT_TEST("PQKeyHeap in interned mode keeps labels in the pool") {
+    LabelPool pool;
+    PQKeyHeap pq(pool);
+    for (int i = 0; i < 500; i++) {
+        int priority = randomInteger(-100, 100);
+        pq.enqueue({ "label" + integerToString(priority % 10), priority });
+    }
+    pq.enqueueInterned({ pool.intern("first"), -1000 });
+    pq.validateInternalState();
+    EXPECT_EQUAL(pool.size(), 20);
+    DataPoint expected = { "first", -1000 };
+    EXPECT_EQUAL(pq.peek(), expected);
+    InternedPoint front = pq.dequeueInterned();
+    EXPECT_EQUAL(pool.toDataPoint(front), expected);
+    while (!pq.isEmpty()) {
+        DataPoint cur = pq.dequeue();
+        EXPECT_EQUAL(cur.label, "label" + integerToString(cur.priority % 10));
+    }
+    EXPECT_ERROR(pq.dequeueInterned());
+
+    PQKeyHeap plain;
+    EXPECT_ERROR(plain.enqueueInterned({ 0, 1 }));
+}
+
+template <typename PQ>
+static void cycleQueue(PQ& pq, const Vector<DataPoint>& input) {
+    pq.clear(); // start with empty queue
+    for (const DataPoint& elem : input) {
+        pq.enqueue(elem);
+    }
+    while (!pq.isEmpty()) {
+        pq.dequeue();
+    }
+}
+
+STUDENT_TEST("PQKeyHeap timing test versus PQHeap with long labels") {
+    for (int n = 100000; n <= 1000000; n *= 10) {
+        Vector<DataPoint> input;
+        for (int i = 0; i < n; i++) {
+            int priority = randomInteger(0, n);
+            input.add({ "a label too long for the small string buffer " + integerToString(priority), priority });
+        }
+        PQHeap heap;
+        PQKeyHeap keyHeap;
+        TIME_OPERATION(n, cycleQueue(heap, input));
+        TIME_OPERATION(n, cycleQueue(keyHeap, input));
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "datapoint.h"
+#include "labelpool.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * Priority queue type implemented using a binary min-heap, with the
+ * DataPoints split into structure-of-arrays storage.
+ *
+ * The heap itself only orders a tight array of (priority, slot) keys.
+ * The label of each element lives in a separate side array at index
+ * slot, and bubbling up or down never touches it. A full DataPoint is
+ * only put back together when an element leaves the queue, so the sifts
+ * move 8-byte keys instead of whole DataPoints with their strings.
+ *
+ * In interned mode the labels live in a LabelPool instead, and the slot
+ * of each key is the label's id in the pool. The queue then holds nothing
+ * but the 8-byte keys, however long or repetitive the labels are.
+ */
+class PQKeyHeap {
+public:
+    /**
+     * Creates a new, empty priority queue.
+     */
+    PQKeyHeap();
+
+    /**
+     * Creates a new, empty priority queue in interned mode, which keeps
+     * its labels in the given pool. The pool must outlive the queue.
+     */
+    PQKeyHeap(LabelPool& pool);
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQKeyHeap();
+
+    /**
+     * Adds a new element into the queue. This operation runs in
+     * time O(log N), where N is the number of elements in the queue.
+     * The rvalue version moves the label in without copying it.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Adds a new element with the given label and priority into the queue.
+     */
+    void emplace(std::string label, int priority);
+
+    /**
+     * Adds an element whose label is already in the pool, without looking
+     * the label up again. Only for a queue in interned mode; otherwise
+     * this function calls error().
+     */
+    void enqueueInterned(const InternedPoint& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Removes and returns the element with the minimum priority value
+     * with its label left in the pool. Only for a queue in interned mode;
+     * otherwise this function calls error().
+     */
+    InternedPoint dequeueInterned();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the priority of the frontmost element without building a
+     * DataPoint for it.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekPriority() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Confirms the heap property holds for the keys and that every key
+     * refers to a distinct, occupied label slot. Calls error() otherwise.
+     */
+    void validateInternalState();
+
+private:
+    struct HeapKey {
+        int priority;
+        uint32_t slot;      // index of the label in _labels, or its id in _pool
+    };
+
+    HeapKey* _keys;         // heap-ordered keys, _numFilled of them
+    LabelPool* _pool;       // label pool in interned mode, otherwise nullptr
+    std::string* _labels;   // labels, indexed by slot; nullptr in interned mode
+    uint32_t* _freeSlots;   // stack of label slots available for reuse; nullptr in interned mode
+    int _numAllocated;      // number of slots allocated in each array
+    int _numFilled;         // number of keys in the heap
+    int _numFree;           // number of entries on the _freeSlots stack
+    int _numSlotsUsed;      // label slots handed out so far, live or free
+
+    void add(HeapKey key);
+    HeapKey removeRoot();
+    void bubbleUp(int index);
+    void bubbleDown(int index);
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQKeyHeap(const PQKeyHeap &) = delete;
+    void operator=(const PQKeyHeap &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQKeyHeap);
+};
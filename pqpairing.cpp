@@ -0,0 +1,396 @@
+/* A pairing heap with O(1) meld and decreaseKey, allocating its nodes from
+ * a pool of blocks.
+ */
+#include "pqpairing.h"
+#include "pqheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/*
+ * A node of the tree. The children of a node form a doubly linked list
+ * starting at child. prev points to the previous sibling, or to the parent
+ * for the first child, so a node can be cut out of the tree in O(1).
+ * Free nodes are chained through next.
+ */
+struct PQPairing::Node {
+    DataPoint point;
+    Node* child = nullptr;
+    Node* next = nullptr;
+    Node* prev = nullptr;
+};
+
+/* Number of nodes carved out of each block of the pool. */
+static const int kNodesPerBlock = 256;
+
+struct PQPairing::Block {
+    Node nodes[kNodesPerBlock];
+    Block* next = nullptr;
+};
+
+PQPairing::PQPairing() {
+    _root = nullptr;
+    _numFilled = 0;
+    _blocks = nullptr;
+    _lastBlock = nullptr;
+    _freeNodes = nullptr;
+    _lastFreeNode = nullptr;
+}
+
+PQPairing::~PQPairing() {
+    while (_blocks != nullptr) {
+        Block* next = _blocks->next;
+        delete _blocks;
+        _blocks = next;
+    }
+}
+
+PQPairing::Handle PQPairing::enqueue(const DataPoint& elem) {
+    return enqueue(DataPoint(elem));
+}
+
+/*
+ * A new element is a one-node heap, linked with the root.
+ */
+PQPairing::Handle PQPairing::enqueue(DataPoint&& elem) {
+    Node* node = newNode();
+    node->point = std::move(elem);
+    _root = _root == nullptr ? node : link(_root, node);
+    _numFilled++;
+    return node;
+}
+
+/*
+ * Removing the root leaves its children as a list of heaps, which are put
+ * back together by mergePairs.
+ */
+DataPoint PQPairing::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    Node* oldRoot = _root;
+    DataPoint result = std::move(oldRoot->point);
+    _root = mergePairs(oldRoot->child);
+    _numFilled--;
+    releaseNode(oldRoot);
+    return result;
+}
+
+DataPoint PQPairing::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return _root->point;
+}
+
+/*
+ * The roots are linked, and the pool of other is spliced onto this one,
+ * both in O(1). other keeps nothing, so its destructor frees nothing.
+ */
+void PQPairing::meld(PQPairing&& other) {
+    if (&other == this) return;
+    if (other._root != nullptr) {
+        _root = _root == nullptr ? other._root : link(_root, other._root);
+    }
+    _numFilled += other._numFilled;
+
+    if (other._blocks != nullptr) {
+        other._lastBlock->next = _blocks;
+        _blocks = other._blocks;
+        if (_lastBlock == nullptr) _lastBlock = other._lastBlock;
+    }
+    if (other._freeNodes != nullptr) {
+        other._lastFreeNode->next = _freeNodes;
+        _freeNodes = other._freeNodes;
+        if (_lastFreeNode == nullptr) _lastFreeNode = other._lastFreeNode;
+    }
+    other._root = nullptr;
+    other._numFilled = 0;
+    other._blocks = other._lastBlock = nullptr;
+    other._freeNodes = other._lastFreeNode = nullptr;
+}
+
+/*
+ * Lowering a priority can only break the heap property between the node
+ * and its parent, so the node's subtree is cut out and linked with the
+ * root.
+ */
+void PQPairing::decreaseKey(Handle node, int newPriority) {
+    if (newPriority > node->point.priority)
+        error("decreaseKey cannot raise the priority of an element");
+    node->point.priority = newPriority;
+    if (node == _root) return;
+
+    if (node->prev->child == node) {
+        node->prev->child = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next != nullptr) node->next->prev = node->prev;
+    node->next = nullptr;
+    node->prev = nullptr;
+    _root = link(_root, node);
+}
+
+bool PQPairing::isEmpty() const {
+    return size() == 0;
+}
+
+int PQPairing::size() const {
+    return _numFilled;
+}
+
+/*
+ * Walks the whole tree to hand every node back to the pool.
+ */
+void PQPairing::clear() {
+    Vector<Node*> toRelease;
+    if (_root != nullptr) toRelease.add(_root);
+    while (!toRelease.isEmpty()) {
+        Node* node = toRelease.removeBack();
+        for (Node* child = node->child; child != nullptr; child = child->next) {
+            toRelease.add(child);
+        }
+        node->point = DataPoint();
+        releaseNode(node);
+    }
+    _root = nullptr;
+    _numFilled = 0;
+}
+
+void PQPairing::validateInternalState() {
+    int count = 0;
+    Vector<Node*> toVisit;
+    if (_root != nullptr) {
+        if (_root->prev != nullptr || _root->next != nullptr) error("Root has siblings!");
+        toVisit.add(_root);
+    }
+    while (!toVisit.isEmpty()) {
+        Node* node = toVisit.removeBack();
+        count++;
+        Node* prev = node;
+        for (Node* child = node->child; child != nullptr; child = child->next) {
+            if (child->point.priority < node->point.priority)
+                error("Child has smaller priority than its parent: " + integerToString(child->point.priority));
+            if (child->prev != prev) error("Broken prev link under priority " + integerToString(node->point.priority));
+            prev = child;
+            toVisit.add(child);
+        }
+    }
+    if (count != _numFilled) error("Tree holds " + integerToString(count) + " nodes but size is " + integerToString(_numFilled));
+}
+
+/*
+ * Takes a node off the free list, first carving up a new block if the
+ * list is empty.
+ */
+PQPairing::Node* PQPairing::newNode() {
+    if (_freeNodes == nullptr) {
+        Block* block = new Block;
+        block->next = _blocks;
+        _blocks = block;
+        if (_lastBlock == nullptr) _lastBlock = block;
+        for (int i = 0; i < kNodesPerBlock; i++) {
+            releaseNode(&block->nodes[i]);
+        }
+    }
+    Node* node = _freeNodes;
+    _freeNodes = node->next;
+    if (_freeNodes == nullptr) _lastFreeNode = nullptr;
+    node->child = nullptr;
+    node->next = nullptr;
+    node->prev = nullptr;
+    return node;
+}
+
+void PQPairing::releaseNode(Node* node) {
+    node->next = _freeNodes;
+    _freeNodes = node;
+    if (_lastFreeNode == nullptr) _lastFreeNode = node;
+}
+
+/*
+ * Links two roots by making the one with the larger priority the first
+ * child of the other, and returns the new root. On a tie a stays on top.
+ */
+PQPairing::Node* PQPairing::link(Node* a, Node* b) {
+    if (b->point.priority < a->point.priority) {
+        swap(a, b);
+    }
+    b->next = a->child;
+    if (a->child != nullptr) a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+    a->next = nullptr;
+    a->prev = nullptr;
+    return a;
+}
+
+/*
+ * The standard two-pass merge of a list of sibling heaps: link them in
+ * pairs from left to right, then link the pairs together from right to
+ * left. Done with loops rather than recursion, since a node can have a
+ * very long list of children.
+ */
+PQPairing::Node* PQPairing::mergePairs(Node* first) {
+    Node* pairs = nullptr;      // linked pairs, most recent first, chained through next
+    while (first != nullptr) {
+        Node* a = first;
+        Node* b = a->next;
+        if (b == nullptr) {
+            a->prev = nullptr;
+            a->next = pairs;
+            pairs = a;
+            break;
+        }
+        first = b->next;
+        a->next = a->prev = nullptr;
+        b->next = b->prev = nullptr;
+        Node* linked = link(a, b);
+        linked->next = pairs;
+        pairs = linked;
+    }
+    Node* result = nullptr;
+    while (pairs != nullptr) {
+        Node* next = pairs->next;
+        pairs->next = nullptr;
+        result = result == nullptr ? pairs : link(pairs, result);
+        pairs = next;
+    }
+    return result;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQPairing example from writeup, validate each step") {
+    PQPairing pq;
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+
+    pq.validateInternalState();
+    for (auto dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.peek().priority, i);
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+}
+
+STUDENT_TEST("PQPairing meld moves everything over and empties the other queue") {
+    PQPairing first;
+    PQPairing second;
+    for (int i = 0; i < 1000; i++) {
+        first.enqueue({ "first", 2 * i });
+        second.enqueue({ "second", 2 * i + 1 });
+    }
+    PQPairing::Handle handle = second.enqueue({ "moved", 5000 });
+    first.meld(std::move(second));
+    first.validateInternalState();
+    second.validateInternalState();
+    EXPECT_EQUAL(first.size(), 2001);
+    EXPECT(second.isEmpty());
+
+    // the handle followed its element into first
+    first.decreaseKey(handle, -1);
+    DataPoint expected = { "moved", -1 };
+    EXPECT_EQUAL(first.dequeue(), expected);
+    for (int i = 0; i < 2000; i++) {
+        EXPECT_EQUAL(first.dequeue().priority, i);
+    }
+
+    // the emptied queue still works, and melding into itself is a no-op
+    second.enqueue({ "again", 1 });
+    second.meld(std::move(second));
+    EXPECT_EQUAL(second.size(), 1);
+    PQPairing empty;
+    second.meld(std::move(empty));
+    EXPECT_EQUAL(second.dequeue().label, "again");
+}
+
+STUDENT_TEST("PQPairing decreaseKey and clear, random workload") {
+    PQPairing pq;
+    Vector<PQPairing::Handle> handles;
+    Vector<int> dequeued(5000, 0);
+    for (int i = 0; i < 5000; i++) {
+        handles.add(pq.enqueue({ integerToString(i), randomInteger(0, 100000) }));
+    }
+    for (int i = 0; i < handles.size(); i++) {
+        if (i % 3 == 1 && !dequeued[i]) {
+            pq.decreaseKey(handles[i], randomInteger(-100000, -1));
+        }
+        if (i % 100 == 0) {
+            // gives the root some children to cut from
+            dequeued[stringToInteger(pq.dequeue().label)] = 1;
+        }
+    }
+    pq.validateInternalState();
+    EXPECT_ERROR(pq.decreaseKey(pq.enqueue({ "", 0 }), 10));
+
+    int last = -100000;
+    for (int i = 0; i < 2000; i++) {
+        int cur = pq.dequeue().priority;
+        EXPECT(cur >= last);
+        last = cur;
+    }
+    pq.clear();
+    pq.validateInternalState();
+    EXPECT(pq.isEmpty());
+    pq.enqueue({ "x", 1 });
+    EXPECT_EQUAL(pq.size(), 1);
+}
+
+/* Runs rounds of a mixed workload over numShards queues: enqueue into random shards, dequeue from a few, and at the
+ * end of each round meld every shard into the first one.
+ */
+static void shardWorkload(PQPairing* shards, int numShards, int rounds, int perRound) {
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < perRound; i++) {
+            shards[randomInteger(0, numShards - 1)].enqueue({ "", randomInteger(0, 1000000) });
+        }
+        for (int s = 0; s < numShards; s++) {
+            for (int i = 0; i < perRound / (4 * numShards) && !shards[s].isEmpty(); i++) {
+                shards[s].dequeue();
+            }
+        }
+        for (int s = 1; s < numShards; s++) {
+            shards[0].meld(std::move(shards[s]));
+        }
+    }
+}
+
+/* Same workload with PQHeap, where melding means dequeueing one heap into another. */
+static void shardWorkload(PQHeap* shards, int numShards, int rounds, int perRound) {
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < perRound; i++) {
+            shards[randomInteger(0, numShards - 1)].enqueue({ "", randomInteger(0, 1000000) });
+        }
+        for (int s = 0; s < numShards; s++) {
+            for (int i = 0; i < perRound / (4 * numShards) && !shards[s].isEmpty(); i++) {
+                shards[s].dequeue();
+            }
+        }
+        for (int s = 1; s < numShards; s++) {
+            while (!shards[s].isEmpty()) {
+                shards[0].enqueue(shards[s].dequeue());
+            }
+        }
+    }
+}
+
+STUDENT_TEST("PQPairing timing test versus PQHeap on mixed enqueue/dequeue/meld") {
+    int numShards = 8;
+    for (int perRound = 10000; perRound <= 100000; perRound *= 10) {
+        PQPairing pairingShards[8];
+        PQHeap heapShards[8];
+        TIME_OPERATION(perRound, shardWorkload(pairingShards, numShards, 20, perRound));
+        TIME_OPERATION(perRound, shardWorkload(heapShards, numShards, 20, perRound));
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "datapoint.h"
+#include "testing/MemoryDiagnostics.h"
+#include <string>
+
+/**
+ * Priority queue type implemented using a pairing heap: a tree of nodes
+ * where each node's priority is no bigger than its children's, and where
+ * two heaps are combined just by making the root with the larger priority
+ * a child of the other. That makes enqueue, meld and decreaseKey O(1),
+ * with dequeue O(log N) amortized.
+ *
+ * Nodes come from a pool owned by the queue, carved out of big blocks, so
+ * enqueue and dequeue don't call new and delete for every element. When
+ * two queues are melded, the pool of one is spliced onto the other.
+ */
+class PQPairing {
+public:
+    struct Node;
+
+    /**
+     * Refers to one element in the queue, for decreaseKey. A handle stays
+     * valid until its element is dequeued or the queue is cleared, and
+     * moves along with the element when its queue is melded into another.
+     */
+    typedef Node* Handle;
+
+    /**
+     * Creates a new, empty priority queue.
+     */
+    PQPairing();
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQPairing();
+
+    /**
+     * Adds a new element into the queue and returns its handle. This
+     * operation runs in time O(1).
+     */
+    Handle enqueue(const DataPoint& element);
+    Handle enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     * This operation runs in amortized time O(log N).
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Moves all elements of other into this queue in O(1) time, leaving
+     * other empty. Handles into other now refer to elements of this queue.
+     */
+    void meld(PQPairing&& other);
+
+    /**
+     * Lowers the priority of the element with the given handle. Calls
+     * error() if newPriority is bigger than the current priority.
+     */
+    void decreaseKey(Handle handle, int newPriority);
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue. Their nodes go back
+     * to the pool for reuse.
+     */
+    void clear();
+
+    /**
+     * Confirms the heap property holds throughout the tree and that the
+     * links between nodes agree with each other. Calls error() if
+     * problems are found.
+     */
+    void validateInternalState();
+
+private:
+    struct Block;
+
+    Node* _root;            // frontmost element, or nullptr if empty
+    int _numFilled;         // number of elements in the queue
+    Block* _blocks;         // every block of nodes owned by the pool
+    Block* _lastBlock;      // tail of _blocks, for splicing in O(1)
+    Node* _freeNodes;       // nodes ready to be handed out
+    Node* _lastFreeNode;    // tail of _freeNodes, for splicing in O(1)
+
+    Node* newNode();
+    void releaseNode(Node* node);
+    static Node* link(Node* a, Node* b);
+    static Node* mergePairs(Node* first);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQPairing(const PQPairing &) = delete;
+    void operator=(const PQPairing &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQPairing);
+};
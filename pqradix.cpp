@@ -0,0 +1,204 @@
+/* A radix heap for monotone integer priorities.
+ */
+#include "pqradix.h"
+#include "pqheap.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include "allocationcounter.h"
+#include <algorithm>
+#include <climits>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/*
+ * Priorities are compared as unsigned keys with the sign bit flipped, which
+ * keeps their order and makes the bit arithmetic well defined.
+ */
+static uint32_t keyOf(int priority) {
+    return uint32_t(priority) ^ 0x80000000u;
+}
+
+static bool lessPriority(const DataPoint& a, const DataPoint& b) {
+    return a.priority < b.priority;
+}
+
+PQRadix::PQRadix() {
+    clear();
+}
+
+void PQRadix::enqueue(DataPoint&& elem) {
+    uint32_t key = keyOf(elem.priority);
+    if (key < _last)
+        error("PQRadix priority " + integerToString(elem.priority) + " is below the last priority dequeued");
+    _buckets[bucketFor(key)].push_back(std::move(elem));
+    _numFilled++;
+}
+
+void PQRadix::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * If bucket 0 is empty, the minimum of the first non-empty bucket becomes
+ * the new last priority, and that bucket's elements are spread out again
+ * around it. All of them land in lower buckets, and the minimum itself
+ * lands in bucket 0.
+ */
+DataPoint PQRadix::dequeue() {
+    if (isEmpty())
+        error("Cannot dequeue an empty pqueue");
+    if (_buckets[0].empty()) {
+        vector<DataPoint>& bucket = _buckets[firstBucket()];
+        _last = keyOf(min_element(bucket.begin(), bucket.end(), lessPriority)->priority);
+        for (DataPoint& elem : bucket) {
+            _buckets[bucketFor(keyOf(elem.priority))].push_back(std::move(elem));
+        }
+        bucket.clear();
+    }
+    DataPoint result = std::move(_buckets[0].back());
+    _buckets[0].pop_back();
+    _numFilled--;
+    return result;
+}
+
+DataPoint PQRadix::peek() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return front();
+}
+
+int PQRadix::peekPriority() const {
+    if (isEmpty())
+        error("Cannot peek empty pqueue");
+    return front().priority;
+}
+
+bool PQRadix::isEmpty() const {
+    return size() == 0;
+}
+
+int PQRadix::size() const {
+    return _numFilled;
+}
+
+/*
+ * The buckets keep their capacity for the next use.
+ */
+void PQRadix::clear() {
+    for (vector<DataPoint>& bucket : _buckets) {
+        bucket.clear();
+    }
+    _last = 0;
+    _numFilled = 0;
+}
+
+void PQRadix::validateInternalState() {
+    int numSeen = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+        for (const DataPoint& elem : _buckets[b]) {
+            uint32_t key = keyOf(elem.priority);
+            if (key < _last || bucketFor(key) != b)
+                error("Element with priority " + integerToString(elem.priority) + " in wrong bucket " + integerToString(b));
+            numSeen++;
+        }
+    }
+    if (numSeen != _numFilled)
+        error("Buckets hold " + integerToString(numSeen) + " elements, not " + integerToString(_numFilled));
+}
+
+/*
+ * Bucket 0 for a key equal to the last one, otherwise one more than the
+ * index of the highest bit in which they differ.
+ */
+int PQRadix::bucketFor(uint32_t key) const {
+    return key == _last ? 0 : 32 - __builtin_clz(key ^ _last);
+}
+
+/*
+ * Assumes the queue is not empty.
+ */
+int PQRadix::firstBucket() const {
+    int b = 0;
+    while (_buckets[b].empty()) {
+        b++;
+    }
+    return b;
+}
+
+/*
+ * The front is any element of bucket 0, or else the minimum of the first
+ * non-empty bucket. Finding it does not spread that bucket out, so peek
+ * leaves the queue as it was. Assumes the queue is not empty.
+ */
+const DataPoint& PQRadix::front() const {
+    if (!_buckets[0].empty())
+        return _buckets[0].back();
+    const vector<DataPoint>& bucket = _buckets[firstBucket()];
+    return *min_element(bucket.begin(), bucket.end(), lessPriority);
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQRadix example from writeup, validate each step") {
+    PQRadix pq;
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    for (const DataPoint& dp : input) {
+        pq.enqueue(dp);
+        pq.validateInternalState();
+    }
+    EXPECT_EQUAL(pq.size(), 9);
+    EXPECT_EQUAL(pq.peek().label, "T");
+    for (int i = 1; i <= 9; i++) {
+        EXPECT_EQUAL(pq.dequeue().priority, i);
+        pq.validateInternalState();
+    }
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeue());
+    EXPECT_ERROR(pq.peek());
+
+    // below the last priority dequeued
+    EXPECT_ERROR(pq.enqueue({ "late", 8 }));
+    pq.enqueue({ "tie", 9 });
+    pq.clear();
+    pq.enqueue({ "negative", -100 });
+    EXPECT_EQUAL(pq.dequeue().priority, -100);
+}
+
+STUDENT_TEST("PQRadix matches PQHeap on a monotone event simulation") {
+    PQRadix pq;
+    PQHeap reference;
+    for (int i = 0; i < 1000; i++) {
+        DataPoint dp = { "", randomInteger(-1000000, 1000000) };
+        pq.enqueue(dp);
+        reference.enqueue(dp);
+    }
+    for (int i = 0; i < 20000; i++) {
+        DataPoint cur = pq.dequeue();
+        EXPECT_EQUAL(cur.priority, reference.dequeue().priority);
+        cur.priority += randomInteger(0, 5000);
+        reference.enqueue(cur);
+        pq.enqueue(std::move(cur));
+    }
+    pq.validateInternalState();
+    while (!reference.isEmpty()) {
+        EXPECT_EQUAL(pq.peekPriority(), reference.peekPriority());
+        EXPECT_EQUAL(pq.dequeue().priority, reference.dequeue().priority);
+    }
+}
+
+STUDENT_TEST("PQRadix handles the extremes of int") {
+    PQRadix pq;
+    Vector<int> priorities = { INT_MAX, 0, INT_MIN, -1, 1, INT_MAX, INT_MIN + 1 };
+    for (int priority : priorities) {
+        pq.enqueue({ "", priority });
+    }
+    sort(priorities.begin(), priorities.end());
+    for (int priority : priorities) {
+        EXPECT_EQUAL(pq.dequeue().priority, priority);
+        pq.validateInternalState();
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "datapoint.h"
+#include "testing/MemoryDiagnostics.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Priority queue type implemented as a radix heap, for monotone workloads
+ * such as event simulation, where no element enqueued ever has a smaller
+ * priority than the last element dequeued.
+ *
+ * Elements are kept in 33 buckets by the position of the highest bit in
+ * which their priority differs from the last priority dequeued. Bucket 0
+ * holds the elements equal to it, and bucket b holds the ones that first
+ * differ in bit b - 1. When bucket 0 runs out, the first non-empty bucket
+ * is emptied into the lower ones around its minimum. An element can only
+ * move down, so it moves at most 32 times, and no two priorities are
+ * compared except while looking for that minimum.
+ */
+class PQRadix {
+public:
+    /**
+     * Creates a new, empty priority queue.
+     */
+    PQRadix();
+
+    /**
+     * Adds a new element into the queue in O(1) time.
+     *
+     * If the priority is smaller than that of the last element dequeued,
+     * this function calls error().
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value, in
+     * O(log C) amortized time, where C is the range of the priorities.
+     * Elements with equal priority come out in no particular order.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the priority of the frontmost element, without copying it.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekPriority() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue, and forgets the last
+     * priority dequeued.
+     */
+    void clear();
+
+    /**
+     * Confirms that every element is in the right bucket and calls error()
+     * if not.
+     */
+    void validateInternalState();
+
+private:
+    static const int kNumBuckets = 33;
+
+    std::vector<DataPoint> _buckets[kNumBuckets];
+    uint32_t _last;         // key of the last element dequeued
+    int _numFilled;         // number of elements in the queue
+
+    int bucketFor(uint32_t key) const;
+    int firstBucket() const;
+    const DataPoint& front() const;
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQRadix(const PQRadix &) = delete;
+    void operator=(const PQRadix &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQRadix);
+};
@@ -0,0 +1,179 @@
+/* Picks a bucket queue, radix heap or binary heap from a declared priority
+ * range, and forwards to it.
+ */
+#include "pqselector.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <climits>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/* Past this many priorities the bucket arrays stop fitting in cache and
+ * scanning the summary bitmap is no longer nearly free.
+ */
+static const long long kMaxBucketRange = 1 << 16;
+
+PQKind choosePQ(int minPriority, int maxPriority, bool monotone) {
+    long long range = (long long) maxPriority - minPriority + 1;
+    if (range <= kMaxBucketRange) {
+        return PQKind::Bucket;
+    }
+    return monotone ? PQKind::Radix : PQKind::Heap;
+}
+
+PQSelector::PQSelector(int minPriority, int maxPriority, bool monotone)
+    : PQSelector(choosePQ(minPriority, maxPriority, monotone), minPriority, maxPriority) {}
+
+PQSelector::PQSelector(PQKind kind, int minPriority, int maxPriority) {
+    if (maxPriority < minPriority)
+        error("PQSelector range is empty");
+    _kind = kind;
+    _minPriority = minPriority;
+    _maxPriority = maxPriority;
+    switch (kind) {
+        case PQKind::Heap: _heap.reset(new PQHeap()); break;
+        case PQKind::Bucket: _bucket.reset(new PQBucket(minPriority, maxPriority)); break;
+        case PQKind::Radix: _radix.reset(new PQRadix()); break;
+    }
+}
+
+PQKind PQSelector::kind() const {
+    return _kind;
+}
+
+void PQSelector::enqueue(DataPoint&& elem) {
+    if (elem.priority < _minPriority || elem.priority > _maxPriority)
+        error("Priority " + integerToString(elem.priority) + " is outside the range of this PQSelector");
+    switch (_kind) {
+        case PQKind::Heap: _heap->enqueue(std::move(elem)); break;
+        case PQKind::Bucket: _bucket->enqueue(std::move(elem)); break;
+        case PQKind::Radix: _radix->enqueue(std::move(elem)); break;
+    }
+}
+
+void PQSelector::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+DataPoint PQSelector::dequeue() {
+    switch (_kind) {
+        case PQKind::Heap: return _heap->dequeue();
+        case PQKind::Bucket: return _bucket->dequeue();
+        default: return _radix->dequeue();
+    }
+}
+
+DataPoint PQSelector::peek() const {
+    switch (_kind) {
+        case PQKind::Heap: return _heap->peek();
+        case PQKind::Bucket: return _bucket->peek();
+        default: return _radix->peek();
+    }
+}
+
+int PQSelector::peekPriority() const {
+    switch (_kind) {
+        case PQKind::Heap: return _heap->peekPriority();
+        case PQKind::Bucket: return _bucket->peekPriority();
+        default: return _radix->peekPriority();
+    }
+}
+
+bool PQSelector::isEmpty() const {
+    return size() == 0;
+}
+
+int PQSelector::size() const {
+    switch (_kind) {
+        case PQKind::Heap: return _heap->size();
+        case PQKind::Bucket: return _bucket->size();
+        default: return _radix->size();
+    }
+}
+
+void PQSelector::clear() {
+    switch (_kind) {
+        case PQKind::Heap: _heap->clear(); break;
+        case PQKind::Bucket: _bucket->clear(); break;
+        case PQKind::Radix: _radix->clear(); break;
+    }
+}
+
+void PQSelector::validateInternalState() {
+    switch (_kind) {
+        case PQKind::Heap: _heap->validateInternalState(); break;
+        case PQKind::Bucket: _bucket->validateInternalState(); break;
+        case PQKind::Radix: _radix->validateInternalState(); break;
+    }
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("choosePQ picks by range and monotonicity") {
+    EXPECT(choosePQ(0, 4095, false) == PQKind::Bucket);
+    EXPECT(choosePQ(0, 4095, true) == PQKind::Bucket);
+    EXPECT(choosePQ(-1000000, 1000000, true) == PQKind::Radix);
+    EXPECT(choosePQ(INT_MIN, INT_MAX, false) == PQKind::Heap);
+    PQSelector pq(INT_MIN, INT_MAX);
+    EXPECT(pq.kind() == PQKind::Heap);
+    EXPECT_ERROR(PQSelector(1, 0));
+}
+
+STUDENT_TEST("PQSelector gives the same order whatever the kind underneath") {
+    for (PQKind kind : { PQKind::Heap, PQKind::Bucket, PQKind::Radix }) {
+        PQSelector pq(kind, 0, 1000);
+        for (int i = 0; i < 500; i++) {
+            pq.enqueue({ "", randomInteger(0, 1000) });
+        }
+        pq.validateInternalState();
+        EXPECT_EQUAL(pq.size(), 500);
+        int last = pq.peekPriority();
+        while (!pq.isEmpty()) {
+            DataPoint cur = pq.dequeue();
+            EXPECT(cur.priority >= last);
+            last = cur.priority;
+        }
+        EXPECT_ERROR(pq.enqueue({ "", 1001 }));
+        EXPECT_ERROR(pq.enqueue({ "", -1 }));
+    }
+}
+
+/* Fills the queue with n priorities from a small range, then drains it. */
+static void fillAndDrain(PQSelector& pq, int n, int numLevels) {
+    pq.clear();
+    for (int i = 0; i < n; i++) {
+        pq.enqueue({ "", randomInteger(0, numLevels - 1) });
+    }
+    while (!pq.isEmpty()) {
+        pq.dequeue();
+    }
+}
+
+/* Repeatedly moves the front event to a random later time, keeping the
+ * number of pending events fixed.
+ */
+static void holdModel(PQSelector& pq, int numOps, int maxDelay) {
+    for (int i = 0; i < numOps; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority += randomInteger(0, maxDelay);
+        pq.enqueue(std::move(cur));
+    }
+}
+
+STUDENT_TEST("PQHeap, PQBucket and PQRadix timing on bounded and monotone workloads") {
+    int n = 1000000;
+    for (PQKind kind : { PQKind::Heap, PQKind::Bucket, PQKind::Radix }) {
+        PQSelector pq(kind, 0, 4095);
+        TIME_OPERATION(n, fillAndDrain(pq, n, 4096));
+    }
+    int pending = 100000;
+    for (PQKind kind : { PQKind::Heap, PQKind::Bucket, PQKind::Radix }) {
+        PQSelector pq(kind, 0, (1 << 16) - 1);
+        for (int i = 0; i < pending; i++) {
+            pq.enqueue({ "", randomInteger(0, 4095) });
+        }
+        TIME_OPERATION(n, holdModel(pq, n, 4096));
+    }
+}
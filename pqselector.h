@@ -0,0 +1,108 @@
+#pragma once
+
+#include "datapoint.h"
+#include "pqbucket.h"
+#include "pqheap.h"
+#include "pqradix.h"
+#include <memory>
+
+/**
+ * The priority queue implementations that PQSelector can choose among.
+ */
+enum class PQKind { Heap, Bucket, Radix };
+
+/**
+ * Returns the kind of queue best suited to priorities from minPriority to
+ * maxPriority, inclusive. A small range goes to PQBucket, a large range
+ * that is monotone (no priority enqueued below the last one dequeued) goes
+ * to PQRadix, and anything else goes to PQHeap.
+ */
+PQKind choosePQ(int minPriority, int maxPriority, bool monotone);
+
+/**
+ * A priority queue that is a PQHeap, PQBucket or PQRadix underneath, as
+ * picked by choosePQ for a declared priority range, and that forwards each
+ * operation to it.
+ */
+class PQSelector {
+public:
+    /**
+     * Creates a new, empty priority queue of the kind choosePQ picks for
+     * the given range.
+     */
+    PQSelector(int minPriority, int maxPriority, bool monotone = false);
+
+    /**
+     * Creates a new, empty priority queue of the given kind for the given
+     * range.
+     */
+    PQSelector(PQKind kind, int minPriority, int maxPriority);
+
+    /**
+     * Returns the kind of queue underneath.
+     */
+    PQKind kind() const;
+
+    /**
+     * Adds a new element into the queue.
+     *
+     * If the priority is outside the declared range, or if the queue is a
+     * PQRadix and the priority is below the last one dequeued, this
+     * function calls error().
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Removes and returns the element with the minimum priority value.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns the priority of the frontmost element, without copying it.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    int peekPriority() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Validates the queue underneath.
+     */
+    void validateInternalState();
+
+private:
+    PQKind _kind;
+    int _minPriority;
+    int _maxPriority;
+    std::unique_ptr<PQHeap> _heap;      // only the one for _kind is set
+    std::unique_ptr<PQBucket> _bucket;
+    std::unique_ptr<PQRadix> _radix;
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQSelector(const PQSelector &) = delete;
+    void operator=(const PQSelector &) = delete;
+};
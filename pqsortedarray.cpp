@@ -6,72 +6,178 @@
 #include "random.h"
 #include "strlib.h"
 #include "datapoint.h"
+#include "allocationcounter.h"
+#include "pqarena.h"
+#include "simdkernels.h"
+#include <algorithm>
+#include <vector>
+#include "vector.h"
 #include "testing/SimpleTest.h"
 using namespace std;
 
 // program constant
 static const int INITIAL_CAPACITY = 10;
 
+#ifdef PQ_ENABLE_STATS
+/*
+ * The number of comparisons a binary search over n priorities makes, which
+ * is what the stats charge for findInsertPosition even though the SIMD
+ * kernel compares several priorities at once.
+ */
+static int binarySearchSteps(int n) {
+    int steps = 0;
+    for (unsigned rest = n; rest != 0; rest >>= 1) {
+        steps++;
+    }
+    return steps;
+}
+#endif
+
 /*
  * The constructor initializes all of the member variables needed for
  * an instance of the PQSortedArray class. The allocated capacity
  * is initialized to a starting constant and a dynamic array of that
- * size is allocated. The number of filled slots is initially zero.
+ * size is allocated from the memory resource. The number of filled
+ * slots is initially zero.
  */
-PQSortedArray::PQSortedArray() {
+PQSortedArray::PQSortedArray(pmr::memory_resource* resource) : PQSortedArray(Mode::Eager, resource) {}
+
+PQSortedArray::PQSortedArray(Mode mode, pmr::memory_resource* resource) {
+    _resource = resource;
+    _mode = mode;
     _numAllocated = INITIAL_CAPACITY;
-    _elements = new DataPoint[_numAllocated];
+    _elements = allocateElements(_resource, _numAllocated);
+    _priorities = (int*) _resource->allocate(_numAllocated * sizeof(int), alignof(int));
     _numFilled = 0;
+    _numSorted = 0;
+    PQ_COUNT(_stats.bytesAllocated += _numAllocated * (long long) (sizeof(DataPoint) + sizeof(int)));
 }
 
 /* The destructor is responsible for cleaning up any resources
  * used by this instance of the PQSortedArray class. The array
- * memory used for elements is deallocated here.
+ * memory used for elements is handed back to its resource here.
  */
 PQSortedArray::~PQSortedArray() {
-    delete[] _elements;
+    freeElements(_resource, _elements, _numAllocated);
+    _resource->deallocate(_priorities, _numAllocated * sizeof(int), alignof(int));
 }
 
 /*
- * If _numFilled is one less than _numAllocated, then we double the size of the array as this one extra space is going
- * to be needed to shift the array and insert the elem where it should be. We double the array to not have to increase
- * the array a small amount each time. Then we find at which index elem will need to be inserted, so when the priority of
- * elem is greater than or equal to the index next to it. Lastly, we shift the entire array over to make space at and
- * for elem, copy over the rest of the array, and insert elem in its spot.
+ * First we make sure the array has the one extra space that is going to be needed to shift the array and insert
+ * the elem where it should be. Then we binary search for the index at which elem will need to be inserted, the
+ * first index whose priority elem is greater than or equal to. Lastly, we shift only the tail of the array from that
+ * index over by one spot, in place, and move elem into the gap. No allocation happens unless the array grows.
+ * In lazy-merge mode, elem is appended to the unsorted region instead, to be merged in later.
  */
-void PQSortedArray::enqueue(DataPoint elem) {
-    if (_numFilled == _numAllocated - 1) {
-        // Create array of double the size of _elements
-        DataPoint* newElements = new DataPoint[_numAllocated * 2];
-        for (int i = 0; i < _numFilled; i++) {
-            // Copy _elements into newElements
-            newElements[i] = _elements[i];
-        }
-        delete [] _elements;
-        _elements = newElements;
-        _numAllocated *= 2;
-    }
-    int insertPos = _numFilled;
-    // Find index at which elem goes
-    for (int i = 0; i < _numFilled; i++) {
-        if (elem.priority >= _elements[i].priority) {
-            insertPos = i;
-            break;
-        }
+void PQSortedArray::enqueue(DataPoint&& elem) {
+    ensureCapacity(_numFilled + 1);
+    if (_mode == Mode::LazyMerge) {
+        append(std::move(elem));
+        return;
     }
+    int insertPos = findInsertPosition(elem.priority);
+    // Shift over the tail of the array one spot after insertPos to make space for elem.
+    move_backward(_elements + insertPos, _elements + _numFilled, _elements + _numFilled + 1);
+    move_backward(_priorities + insertPos, _priorities + _numFilled, _priorities + _numFilled + 1);
+    _priorities[insertPos] = elem.priority;
+    _elements[insertPos] = std::move(elem);
+    PQ_COUNT(_stats.comparisons += binarySearchSteps(_numFilled));
+    PQ_COUNT(_stats.moves += _numFilled - insertPos + 1);
+    PQ_COUNT(_stats.recordSift(_numFilled - insertPos));
     _numFilled ++;
-    // Shift over the array one spot after insertPos to make space for elem.
-    DataPoint* newElements = new DataPoint[_numAllocated];
-    for (int i = _numFilled; i > insertPos; i--) {
-        newElements[i] = _elements[i - 1];
+    _numSorted = _numFilled;
+}
+
+/*
+ * Copies the element and enqueues the copy.
+ */
+void PQSortedArray::enqueue(const DataPoint& elem) {
+    enqueue(DataPoint(elem));
+}
+
+/*
+ * Builds the element from its parts and enqueues it without copying the
+ * label.
+ */
+void PQSortedArray::emplace(string label, int priority) {
+    enqueue(DataPoint{ std::move(label), priority });
+}
+
+/*
+ * Merges a copy of the batch into the array in one pass, or in lazy-merge
+ * mode appends it to the unsorted region.
+ */
+void PQSortedArray::enqueueMany(const Vector<DataPoint>& elements) {
+    int numAdded = elements.size();
+    if (numAdded == 0)
+        return;
+    ensureCapacity(_numFilled + numAdded);
+    if (_mode == Mode::LazyMerge) {
+        for (const DataPoint& elem : elements) {
+            append(DataPoint(elem));
+        }
+        return;
     }
-    // Insert the elements before insertPos that do not need to be shifted
-    for (int i = 0; i < insertPos; i++) {
-        newElements[i] = _elements[i];
+    vector<DataPoint> batch(elements.begin(), elements.end());
+    PQ_COUNT(_stats.moves += numAdded);
+    mergeBatch(batch, _numFilled);
+    _numFilled += numAdded;
+    _numSorted = _numFilled;
+}
+
+/*
+ * Puts elem in the next slot, at the end of the unsorted region. The
+ * caller has made room for it.
+ */
+void PQSortedArray::append(DataPoint&& elem) {
+    _priorities[_numFilled] = elem.priority;
+    _elements[_numFilled++] = std::move(elem);
+    PQ_COUNT(_stats.moves++);
+}
+
+/*
+ * Moves the unsorted region out and merges it back into the sorted one.
+ */
+void PQSortedArray::mergePending() {
+    if (_numSorted == _numFilled)
+        return;
+    vector<DataPoint> batch(make_move_iterator(_elements + _numSorted), make_move_iterator(_elements + _numFilled));
+    PQ_COUNT(_stats.moves += batch.size());
+    mergeBatch(batch, _numSorted);
+    _numSorted = _numFilled;
+}
+
+/*
+ * Sorts the batch, which is in enqueue order, into the same decreasing
+ * order as the array and merges it with the first numOld slots from the
+ * back, writing each element into its final slot. The old elements only
+ * ever move to higher indices, so the merge needs no second array, but
+ * there must be room for the whole batch after them. Within the batch
+ * later elements are put in front of earlier ones, and on ties the batch
+ * goes in front of the old elements, which keeps equal elements in
+ * enqueue order.
+ */
+void PQSortedArray::mergeBatch(vector<DataPoint>& batch, int numOld) {
+    int numAdded = batch.size();
+    reverse(batch.begin(), batch.end());
+    stable_sort(batch.begin(), batch.end(), [&](const DataPoint& a, const DataPoint& b) {
+        PQ_COUNT(_stats.comparisons++);
+        return a.priority > b.priority;
+    });
+
+    int old = numOld - 1;
+    int added = numAdded - 1;
+    for (int spot = numOld + numAdded - 1; added >= 0; spot--) {
+        PQ_COUNT(_stats.comparisons += (old >= 0));
+        PQ_COUNT(_stats.moves++);
+        if (old >= 0 && _priorities[old] <= batch[added].priority) {
+            _priorities[spot] = _priorities[old];
+            _elements[spot] = std::move(_elements[old--]);
+        } else {
+            _priorities[spot] = batch[added].priority;
+            _elements[spot] = std::move(batch[added--]);
+        }
     }
-    delete [] _elements;
-    _elements = newElements;
-    _elements[insertPos] = elem;
 }
 
 /*
@@ -86,18 +192,28 @@ int PQSortedArray::size() const {
  * Since the array elements are stored in decreasing sorted order
  * by priority, the frontmost is located in the last filled
  * slot of the array. This function returns the element at that index.
+ * In lazy-merge mode the unsorted region is scanned for its first
+ * smallest element instead of being merged. Everything in the sorted
+ * region was enqueued earlier, so the sorted front wins ties.
  */
 DataPoint PQSortedArray::peek() const {
     if (isEmpty()) {
         error("Cannot peek empty pqueue");
     }
-    return _elements[_numFilled - 1];
+    if (_numSorted == _numFilled) {
+        return _elements[_numFilled - 1];
+    }
+    int pending = _numSorted + minIndex(_priorities + _numSorted, _numFilled - _numSorted);
+    if (_numSorted > 0 && _priorities[_numSorted - 1] <= _priorities[pending]) {
+        return _elements[_numSorted - 1];
+    }
+    return _elements[pending];
 }
 
 /*
  * Since the array elements are stored in decreasing sorted order
  * by priority, the frontmost element is located in the last filled
- * slot of the array. This function returns the element at that index
+ * slot of the array. This function moves the element out of that index
  * while decrementing the count of filled slots to record that an
  * element has been removed.
  */
@@ -105,7 +221,28 @@ DataPoint PQSortedArray::dequeue() {
     if (isEmpty()) {
         error("Cannot dequeue empty pqueue");
     }
-    return _elements[--_numFilled];
+    mergePending();
+    PQ_COUNT(_stats.moves++);
+    _numSorted--;
+    return std::move(_elements[--_numFilled]);
+}
+
+/*
+ * The k frontmost elements are the last k in the array, so they are moved
+ * out from the back in dequeue order.
+ */
+void PQSortedArray::dequeueMany(int k, Vector<DataPoint>& out) {
+    if (k < 0) {
+        error("Cannot dequeue a negative number of elements");
+    }
+    mergePending();
+    int stop = max(0, _numFilled - k);
+    for (int i = _numFilled - 1; i >= stop; i--) {
+        out.add(std::move(_elements[i]));
+    }
+    PQ_COUNT(_stats.moves += _numFilled - stop);
+    _numFilled = stop;
+    _numSorted = stop;
 }
 
 /*
@@ -116,6 +253,14 @@ bool PQSortedArray::isEmpty() const {
     return size() == 0;
 }
 
+PQStats PQSortedArray::stats() const {
+    return _stats;
+}
+
+void PQSortedArray::resetStats() {
+    _stats = PQStats();
+}
+
 /*
  * Updates internal state to reflect that the queue is empty, e.g. count
  * of filled slots is reset to zero. The array memory stays allocated
@@ -125,6 +270,47 @@ bool PQSortedArray::isEmpty() const {
  */
 void PQSortedArray::clear() {
     _numFilled = 0;
+    _numSorted = 0;
+}
+
+/*
+ * Searches the packed, decreasing priorities for the first index whose
+ * priority is less than or equal to the given one, with the SIMD lower
+ * bound kernel. Inserting there places a new element in front of any
+ * older elements of equal priority, so equal elements are dequeued in
+ * the order they were enqueued.
+ */
+int PQSortedArray::findInsertPosition(int priority) const {
+    return lowerBoundDescending(_priorities, _numFilled, priority);
+}
+
+
+/*
+ * Makes sure the array has room for numNeeded elements plus the one spare
+ * slot that enqueue shifts the tail into, doubling its size (or more, for
+ * big batches) and moving the elements over. Doubling keeps the array from
+ * having to be increased by a small amount each time.
+ */
+void PQSortedArray::ensureCapacity(int numNeeded) {
+    if (numNeeded < _numAllocated)
+        return;
+    int newAllocated = max(_numAllocated * 2, numNeeded + 1);
+    // Create array of the new size
+    DataPoint* newElements = allocateElements(_resource, newAllocated);
+    int* newPriorities = (int*) _resource->allocate(newAllocated * sizeof(int), alignof(int));
+    for (int i = 0; i < _numFilled; i++) {
+        // Move _elements into newElements
+        newElements[i] = std::move(_elements[i]);
+    }
+    copy(_priorities, _priorities + _numFilled, newPriorities);
+    PQ_COUNT(_stats.reallocations++);
+    PQ_COUNT(_stats.bytesAllocated += newAllocated * (long long) (sizeof(DataPoint) + sizeof(int)));
+    PQ_COUNT(_stats.moves += _numFilled);
+    freeElements(_resource, _elements, _numAllocated);
+    _resource->deallocate(_priorities, _numAllocated * sizeof(int), alignof(int));
+    _elements = newElements;
+    _priorities = newPriorities;
+    _numAllocated = newAllocated;
 }
 
 /*
@@ -133,6 +319,9 @@ void PQSortedArray::clear() {
 void PQSortedArray::printDebugInfo(string label) {
     cout << label << endl;
     for (int i = 0; i < size(); i++) {
+        if (i == _numSorted) {
+            cout << "waiting to be merged:" << endl;
+        }
         cout << "[" << i << "] = " << _elements[i] << endl;
     }
 }
@@ -147,16 +336,27 @@ void PQSortedArray::validateInternalState() {
      */
     if (_numFilled > _numAllocated) error("Too many elements in not enough space!");
 
-    /* Loop over the elements in the array and compare priority of pair of
+    /* The unsorted region comes after the sorted one, and only exists in lazy-merge mode. */
+    if (_numSorted < 0 || _numSorted > _numFilled) error("Sorted region runs past the filled slots!");
+    if (_mode == Mode::Eager && _numSorted != _numFilled) error("Unmerged elements in an eager queue!");
+
+    /* Loop over the elements in the sorted region and compare priority of pair of
      * neighboring elements. If current element has larger priority
      * than the previous this indicates array elements are not in
      * in expected decreasing sorted order. Use error to report this problem.
      */
-    for (int i = 1; i < size(); i++) {
+    for (int i = 1; i < _numSorted; i++) {
         if (_elements[i].priority > _elements[i-1].priority) {
             error("Array elements out of order at index " + integerToString(i));
         }
     }
+
+    /* The packed priorities must match the elements in both regions. */
+    for (int i = 0; i < size(); i++) {
+        if (_priorities[i] != _elements[i].priority) {
+            error("Packed priority out of date at index " + integerToString(i));
+        }
+    }
 }
 
 /* * * * * * Test Cases Below This Point * * * * * */
@@ -182,6 +382,164 @@ STUDENT_TEST("Enqueue in between") {
 }
 
 
+STUDENT_TEST("emplace and rvalue enqueue keep labels with their priorities") {
+    PQSortedArray pq;
+    pq.emplace("three", 3);
+    DataPoint one = { "one", 1 };
+    pq.enqueue(one);
+    pq.enqueue(DataPoint{ "two", 2 });
+    pq.validateInternalState();
+    EXPECT_EQUAL(one.label, "one");
+
+    Vector<DataPoint> expected = { { "one", 1 }, { "two", 2 }, { "three", 3 } };
+    for (const DataPoint& dp : expected) {
+        EXPECT_EQUAL(pq.dequeue(), dp);
+    }
+}
+
+STUDENT_TEST("Equal priorities dequeue in the order they were enqueued") {
+    PQSortedArray pq;
+    for (int i = 0; i < 30; i++) {
+        pq.enqueue({ integerToString(i), i % 3 });
+    }
+    pq.validateInternalState();
+    for (int priority = 0; priority < 3; priority++) {
+        for (int i = priority; i < 30; i += 3) {
+            DataPoint expected = { integerToString(i), priority };
+            EXPECT_EQUAL(pq.dequeue(), expected);
+        }
+    }
+}
+
+STUDENT_TEST("Steady-state enqueue/dequeue cycle does no allocations") {
+    PQSortedArray pq;
+    int n = 1000;
+    for (int i = 0; i < n; i++) {
+        pq.emplace("a label too long for the small string buffer " + integerToString(i), randomInteger(0, n));
+    }
+    long before = numHeapAllocations();
+    for (int i = 0; i < 10 * n; i++) {
+        DataPoint cur = pq.dequeue();
+        cur.priority += randomInteger(0, n);
+        pq.enqueue(std::move(cur));
+    }
+    EXPECT_EQUAL(numHeapAllocations() - before, 0);
+    EXPECT_EQUAL(pq.size(), n);
+    pq.validateInternalState();
+}
+
+STUDENT_TEST("enqueueMany merges batches and keeps equal priorities in enqueue order") {
+    PQSortedArray batched;
+    PQSortedArray single;
+    for (int round = 0; round < 5; round++) {
+        Vector<DataPoint> batch;
+        for (int i = 0; i < 50 * round; i++) {
+            batch.add({ integerToString(round) + "-" + integerToString(i), randomInteger(0, 20) });
+        }
+        batched.enqueueMany(batch);
+        batched.validateInternalState();
+        for (const DataPoint& dp : batch) {
+            single.enqueue(dp);
+        }
+    }
+    EXPECT_EQUAL(batched.size(), single.size());
+    while (!single.isEmpty()) {
+        EXPECT_EQUAL(batched.dequeue(), single.dequeue());
+    }
+}
+
+STUDENT_TEST("dequeueMany takes the tail in dequeue order") {
+    PQSortedArray pq;
+    for (int i = 0; i < 10; i++) {
+        pq.enqueue({ integerToString(i), i });
+    }
+    Vector<DataPoint> out;
+    pq.dequeueMany(4, out);
+    EXPECT_EQUAL(out.size(), 4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQUAL(out[i].priority, i);
+    }
+    pq.dequeueMany(0, out);
+    EXPECT_EQUAL(out.size(), 4);
+    pq.dequeueMany(100, out);
+    EXPECT_EQUAL(out.size(), 10);
+    EXPECT_EQUAL(out[9].priority, 9);
+    EXPECT(pq.isEmpty());
+    EXPECT_ERROR(pq.dequeueMany(-1, out));
+}
+
+STUDENT_TEST("Lazy-merge mode dequeues exactly like eager mode, through bursts of every size") {
+    PQSortedArray eager;
+    PQSortedArray lazy(PQSortedArray::Mode::LazyMerge);
+    int label = 0;
+    for (int round = 0; round < 30; round++) {
+        int numIn = randomInteger(0, 60);
+        for (int i = 0; i < numIn; i++) {
+            DataPoint elem = { integerToString(label++), randomInteger(0, 10) };
+            if (randomChance(0.2)) {
+                eager.enqueueMany({ elem });
+                lazy.enqueueMany({ elem });
+            } else {
+                eager.enqueue(elem);
+                lazy.enqueue(elem);
+            }
+            // peek scans the pending region without merging it
+            EXPECT_EQUAL(lazy.peek(), eager.peek());
+            lazy.validateInternalState();
+        }
+        EXPECT_EQUAL(lazy.size(), eager.size());
+        if (!eager.isEmpty()) {
+            EXPECT_EQUAL(lazy.peek(), eager.peek());
+            lazy.validateInternalState();
+        }
+        int numOut = randomInteger(0, eager.size());
+        for (int i = 0; i < numOut; i++) {
+            EXPECT_EQUAL(lazy.dequeue(), eager.dequeue());
+        }
+        lazy.validateInternalState();
+    }
+    Vector<DataPoint> eagerRest, lazyRest;
+    eager.dequeueMany(eager.size(), eagerRest);
+    lazy.enqueue({ "last", -1 });
+    lazy.dequeueMany(lazy.size(), lazyRest);
+    EXPECT_EQUAL(lazyRest[0], DataPoint({ "last", -1 }));
+    lazyRest.remove(0);
+    EXPECT_EQUAL(lazyRest, eagerRest);
+
+    lazy.enqueue({ "x", 1 });
+    lazy.clear();
+    EXPECT(lazy.isEmpty());
+    lazy.validateInternalState();
+    EXPECT_ERROR(lazy.dequeue());
+}
+
+/* Keeps base elements in the queue and puts bursts of enqueues and then dequeues through it. */
+static void runBursts(PQSortedArray& pq, int base, int burst, int numBursts) {
+    Vector<DataPoint> elements;
+    for (int i = 0; i < base; i++) {
+        elements.add({ "", randomInteger(0, 1000000) });
+    }
+    pq.enqueueMany(elements);
+    for (int round = 0; round < numBursts; round++) {
+        for (int i = 0; i < burst; i++) {
+            pq.enqueue({ "", randomInteger(0, 1000000) });
+        }
+        for (int i = 0; i < burst; i++) {
+            pq.dequeue();
+        }
+    }
+    pq.clear();
+}
+
+STUDENT_TEST("PQSortedArray time trial, bursts of enqueues then dequeues, eager versus lazy merge") {
+    for (int base = 10000; base <= 160000; base *= 4) {
+        PQSortedArray eager;
+        PQSortedArray lazy(PQSortedArray::Mode::LazyMerge);
+        TIME_OPERATION(base, runBursts(eager, base, 2000, 5));
+        TIME_OPERATION(base, runBursts(lazy, base, 2000, 5));
+    }
+}
+
 /* * * * * Provided Tests Below This Point * * * * */
 
 PROVIDED_TEST("PQSortedArray example from writeup") {
@@ -364,12 +722,8 @@ static void emptyQueue(PQSortedArray& pq, int n) {
 PROVIDED_TEST("PQSortedArray timing test, fillQueue and emptyQueue") {
     PQSortedArray pq;
 
-    TIME_OPERATION(10000, fillQueue(pq, 10000));
-    TIME_OPERATION(10000, emptyQueue(pq, 10000));
-    TIME_OPERATION(20000, fillQueue(pq, 20000));
-    TIME_OPERATION(20000, emptyQueue(pq, 20000));
-    TIME_OPERATION(30000, fillQueue(pq, 30000));
-    TIME_OPERATION(30000, emptyQueue(pq, 30000));
-    TIME_OPERATION(40000, fillQueue(pq, 40000));
-    TIME_OPERATION(40000, emptyQueue(pq, 40000));
+    for (int n = 25000; n <= 200000; n *= 2) {
+        TIME_OPERATION(n, fillQueue(pq, n));
+        TIME_OPERATION(n, emptyQueue(pq, n));
+    }
 }
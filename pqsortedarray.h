@@ -0,0 +1,159 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include "pqstats.h"
+#include "testing/MemoryDiagnostics.h"
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+/**
+ * Priority queue type implemented using a sorted array.
+ *
+ * The elements are stored in decreasing sorted order by priority
+ * value so that the frontmost element (the one with the smallest
+ * priority value) is in the last filled slot of the array.
+ *
+ * In lazy-merge mode, enqueue just appends to an unsorted region after
+ * the sorted one. The first dequeue after a burst of enqueues sorts that
+ * region and merges it into the sorted one in a single pass,
+ * so a burst of M enqueues into a queue of N elements costs
+ * O(N + M log M) instead of the O(N * M) of shifting the tail over for
+ * every enqueue. The merge needs a scratch buffer of M elements. peek
+ * leaves the layout alone and scans the unsorted region for the front,
+ * so concurrent calls to peek are as safe as for any other const method.
+ */
+class PQSortedArray {
+public:
+    enum class Mode { Eager, LazyMerge };
+
+    /**
+     * Creates a new, empty priority queue. Its element array is allocated
+     * from the given memory resource, such as a PQArena's, or else with
+     * the default resource, which uses new and delete.
+     */
+    explicit PQSortedArray(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * Creates a new, empty priority queue in the given mode, with its
+     * element array allocated from the given memory resource.
+     */
+    explicit PQSortedArray(Mode mode, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * Cleans up all memory allocated by this priority queue.
+     */
+    ~PQSortedArray();
+
+    /**
+     * Adds a new element into the queue. Finding the position takes
+     * O(log N) comparisons and shifting the tail over takes O(N) moves
+     * in the worst case, where N is the number of elements in the queue.
+     * In lazy-merge mode the element is only appended, in O(1) time.
+     * The rvalue version moves the element in without copying its label.
+     */
+    void enqueue(const DataPoint& element);
+    void enqueue(DataPoint&& element);
+
+    /**
+     * Adds a new element with the given label and priority into the queue.
+     */
+    void emplace(std::string label, int priority);
+
+    /**
+     * Adds all of the given elements into the queue. The batch is sorted
+     * and merged into the array from the back in one O(N + M log M) pass,
+     * where M is the size of the batch, instead of shifting the tail once
+     * per element. In lazy-merge mode the batch is only appended.
+     */
+    void enqueueMany(const Vector<DataPoint>& elements);
+
+    /**
+     * Removes and returns the element that is frontmost in this
+     * priority queue. The frontmost element is the one with the
+     * minimum priority value. The element is moved out of the array
+     * rather than copied.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint dequeue();
+
+    /**
+     * Removes the k frontmost elements and adds them to the end of out,
+     * in the order dequeue would have returned them. If the queue has
+     * fewer than k elements, all of them are removed. The elements are
+     * the contiguous tail of the array, so this is just k moves.
+     *
+     * If k is negative, this function calls error().
+     */
+    void dequeueMany(int k, Vector<DataPoint>& out);
+
+    /**
+     * Returns, but does not remove, the element that is frontmost.
+     *
+     * If the priority queue is empty, this function calls error().
+     */
+    DataPoint peek() const;
+
+    /**
+     * Returns whether the priority queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of elements in this priority queue.
+     */
+    int size() const;
+
+    /**
+     * Removes all elements from the priority queue.
+     */
+    void clear();
+
+    /**
+     * Returns the counts of the work this queue has done since it was
+     * created or since the last resetStats(). They are only counted in
+     * builds with PQ_ENABLE_STATS defined, and are zero otherwise.
+     */
+    PQStats stats() const;
+
+    /**
+     * Sets all of the counts returned by stats() back to zero.
+     */
+    void resetStats();
+
+    /**
+     * Prints the contents of internal array for debugging.
+     */
+    void printDebugInfo(std::string label);
+
+    /**
+     * Confirms the internal state of the member variables appears
+     * valid and calls error() if problems are found.
+     */
+    void validateInternalState();
+
+private:
+    DataPoint* _elements;   // dynamic array
+    int* _priorities;       // priority of each element, packed for the SIMD lower bound
+    std::pmr::memory_resource* _resource;   // where _elements comes from
+    Mode _mode;             // whether enqueue sorts right away
+    int _numAllocated;      // number of slots allocated in array
+    int _numFilled;         // number of slots filled in array
+    int _numSorted;         // slots before this are sorted, the rest wait to be merged
+    PQStats _stats;         // work done, for stats()
+
+    int findInsertPosition(int priority) const;
+    void ensureCapacity(int numNeeded);
+    void append(DataPoint&& elem);
+    void mergePending();
+    void mergeBatch(std::vector<DataPoint>& batch, int numOld);
+
+    /* Weird C++isms: You're not allowed to copy or assign priority queues. */
+    PQSortedArray(const PQSortedArray &) = delete;
+    void operator=(const PQSortedArray &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(PQSortedArray);
+};
@@ -0,0 +1,203 @@
+/* The counts behind the stats() of the queues, and the tests of what the
+ * queues count.
+ */
+#include "pqstats.h"
+#include "pqheap.h"
+#include "pqsortedarray.h"
+#include "pqclient.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <sstream>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+/*
+ * The bucket is the number of bits in the depth, which is 0 for 0, 1 for
+ * 1, 2 for 2 and 3, and so on.
+ */
+void PQStats::recordSift(int depth) {
+    int bucket = 0;
+    for (unsigned rest = depth; rest != 0; rest >>= 1) {
+        bucket++;
+    }
+    siftDepths[bucket]++;
+}
+
+long long PQStats::numSifts() const {
+    long long total = 0;
+    for (long long count : siftDepths) {
+        total += count;
+    }
+    return total;
+}
+
+PQStats& PQStats::operator+=(const PQStats& other) {
+    comparisons += other.comparisons;
+    moves += other.moves;
+    for (int b = 0; b < kNumSiftBuckets; b++) {
+        siftDepths[b] += other.siftDepths[b];
+    }
+    reallocations += other.reallocations;
+    bytesAllocated += other.bytesAllocated;
+    return *this;
+}
+
+string PQStats::toString() const {
+    ostringstream out;
+    out << "comparisons=" << comparisons << " moves=" << moves
+        << " reallocations=" << reallocations << " bytesAllocated=" << bytesAllocated
+        << " siftDepths={";
+    bool first = true;
+    for (int b = 0; b < kNumSiftBuckets; b++) {
+        if (siftDepths[b] == 0) continue;
+        out << (first ? "" : " ");
+        if (b <= 1) {
+            out << b;
+        } else {
+            out << (1LL << (b - 1)) << "-" << (1LL << b) - 1;
+        }
+        out << ":" << siftDepths[b];
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+bool statsEnabled() {
+#ifdef PQ_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("PQStats histogram buckets, sums and text") {
+    PQStats stats;
+    for (int depth : { 0, 1, 2, 3, 4, 7, 8, 1000 }) {
+        stats.recordSift(depth);
+    }
+    EXPECT_EQUAL(stats.siftDepths[0], 1);
+    EXPECT_EQUAL(stats.siftDepths[1], 1);
+    EXPECT_EQUAL(stats.siftDepths[2], 2);
+    EXPECT_EQUAL(stats.siftDepths[3], 2);
+    EXPECT_EQUAL(stats.siftDepths[4], 1);
+    EXPECT_EQUAL(stats.siftDepths[10], 1);
+    EXPECT_EQUAL(stats.numSifts(), 8);
+
+    PQStats other;
+    other.comparisons = 5;
+    other.moves = 7;
+    other.reallocations = 1;
+    other.bytesAllocated = 64;
+    other.recordSift(2);
+    stats += other;
+    stats += other;
+    EXPECT_EQUAL(stats.comparisons, 10);
+    EXPECT_EQUAL(stats.siftDepths[2], 4);
+    EXPECT_EQUAL(stats.toString(),
+                 "comparisons=10 moves=14 reallocations=2 bytesAllocated=128 "
+                 "siftDepths={0:1 1:1 2-3:4 4-7:2 8-15:1 512-1023:1}");
+}
+
+STUDENT_TEST("PQHeap stats count the work, or stay zero when stats are off") {
+    PQHeap pq;
+    int n = 1000;
+    for (int i = n; i > 0; i--) {
+        pq.enqueue({ "", i });
+    }
+    for (int i = 0; i < n; i++) {
+        pq.dequeue();
+    }
+    PQStats stats = pq.stats();
+    if (!statsEnabled()) {
+        EXPECT_EQUAL(stats.toString(), PQStats().toString());
+        return;
+    }
+
+    /* Every new element is the smallest yet, so it bubbles all the way up.
+     * Each dequeue but the last bubbles the last element down from the root.
+     */
+    long long levelsUp = 0;
+    for (int i = 0; i < n; i++) {
+        for (int spot = i; spot > 0; spot = (spot - 1) / 2) {
+            levelsUp++;
+        }
+    }
+    EXPECT_EQUAL(stats.numSifts(), 2 * n - 1);
+    EXPECT(stats.comparisons >= levelsUp);
+    EXPECT(stats.moves >= levelsUp + 2 * n);
+
+    /* The array grows from 10 slots by doubling: 20, 40, ..., 1280. */
+    EXPECT_EQUAL(stats.reallocations, 7);
+    EXPECT_EQUAL(stats.bytesAllocated, (10 + 20 + 40 + 80 + 160 + 320 + 640 + 1280) * (long long) sizeof(DataPoint));
+
+    pq.resetStats();
+    EXPECT_EQUAL(pq.stats().toString(), PQStats().toString());
+}
+
+STUDENT_TEST("PQSortedArray stats measure how far the tail shifts") {
+    PQSortedArray front;
+    PQSortedArray back;
+    int n = 500;
+    for (int i = 0; i < n; i++) {
+        front.enqueue({ "", i });      // goes in at index 0, shifting everything
+        back.enqueue({ "", n - i });   // goes in at the end, shifting nothing
+    }
+    if (!statsEnabled()) {
+        EXPECT_EQUAL(front.stats().toString(), PQStats().toString());
+        return;
+    }
+    EXPECT_EQUAL(back.stats().siftDepths[0], n);
+    EXPECT_EQUAL(front.stats().siftDepths[0], 1);
+    EXPECT_EQUAL(front.stats().moves - back.stats().moves, (long long) n * (n - 1) / 2);
+    EXPECT_EQUAL(front.stats().reallocations, back.stats().reallocations);
+}
+
+STUDENT_TEST("pqSort and topK add the stats of each run into the caller's") {
+    PQStats stats;
+    Vector<DataPoint> small;
+    for (int i = 0; i < 100; i++) {
+        small.add({ "", randomInteger(0, 50) });
+    }
+    pqSort(small, stats);
+    PQStats afterOne = stats;
+    pqSort(small, stats);
+
+    int n = 10000;
+    Vector<DataPoint> large;
+    for (int i = 0; i < n; i++) {
+        large.add({ "", randomInteger(-n, n) });
+    }
+    PQStats radix;
+    pqSort(large, radix);
+
+    stringstream stream;
+    for (const DataPoint& point : large) {
+        stream << point << " ";
+    }
+    PQStats topKStats;
+    Vector<DataPoint> best = topK(stream, 10, topKStats);
+    EXPECT_EQUAL(best.size(), 10);
+
+    if (!statsEnabled()) {
+        EXPECT_EQUAL(stats.toString(), PQStats().toString());
+        EXPECT_EQUAL(topKStats.toString(), PQStats().toString());
+        return;
+    }
+    EXPECT(afterOne.comparisons > 0);
+    EXPECT(stats.comparisons > afterOne.comparisons);
+    EXPECT_EQUAL(stats.numSifts(), 2 * afterOne.numSifts());
+
+    /* The radix sort compares nothing and moves each element at most once, plus once per cycle. */
+    EXPECT_EQUAL(radix.comparisons, 0);
+    EXPECT(radix.moves <= n + n / 2);
+    EXPECT(radix.bytesAllocated > 0);
+
+    /* Every record past the first ten costs at least one comparison against the weakest kept. */
+    EXPECT(topKStats.comparisons >= n - 10);
+}
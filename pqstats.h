@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+
+/*
+ * PQ_COUNT(statement) runs the statement only in builds with
+ * PQ_ENABLE_STATS defined, and compiles to nothing otherwise, so the
+ * counting in the hot paths of the queues costs nothing unless it is
+ * asked for. The queues hold their PQStats member either way, so their
+ * layout doesn't depend on the flag and files built with and without it
+ * can be linked together.
+ */
+#ifdef PQ_ENABLE_STATS
+#define PQ_COUNT(statement) statement
+#else
+#define PQ_COUNT(statement) ((void) 0)
+#endif
+
+/**
+ * Counts of the work a priority queue has done, for finding out where
+ * the time goes when a queue is slow.
+ *
+ * A comparison is one test of two priorities against each other, and a
+ * move is one DataPoint moved or copied from one slot to another. A sift
+ * is one element working its way into place: a bubble up or down in a
+ * heap, or the shift of the tail in a sorted array. siftDepths is a
+ * histogram of how far the sifts went, in powers of two: bucket 0 holds
+ * the sifts that went nowhere, and bucket b > 0 the ones that went at
+ * least 2^(b-1) and less than 2^b levels (or slots). Reallocations counts
+ * the times the element array grew, and bytesAllocated every byte asked
+ * for, including the first array.
+ *
+ * The queues only count when built with PQ_ENABLE_STATS defined. In
+ * other builds their stats are always zero.
+ */
+struct PQStats {
+    static const int kNumSiftBuckets = 33;
+
+    long long comparisons = 0;
+    long long moves = 0;
+    long long siftDepths[kNumSiftBuckets] = {};
+    long long reallocations = 0;
+    long long bytesAllocated = 0;
+
+    /**
+     * Adds one sift of the given depth to the histogram.
+     */
+    void recordSift(int depth);
+
+    /**
+     * Returns the total number of sifts in the histogram.
+     */
+    long long numSifts() const;
+
+    /**
+     * Adds every count of other into these, so the stats of several queues
+     * can be summed up into the stats of one run.
+     */
+    PQStats& operator+=(const PQStats& other);
+
+    /**
+     * Returns the counts as one line of text, listing only the buckets of
+     * the histogram that aren't empty, such as
+     *
+     *     comparisons=120 moves=98 reallocations=2 bytesAllocated=1440 siftDepths={0:3 1:5 2-3:12}
+     */
+    std::string toString() const;
+};
+
+/**
+ * Returns whether this build counts stats, that is, whether it was built
+ * with PQ_ENABLE_STATS defined.
+ */
+bool statsEnabled();
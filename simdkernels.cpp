@@ -0,0 +1,310 @@
+/* Scalar, SSE4.1 and AVX2 versions of the min-of-n and lower-bound kernels,
+ * and the run time dispatch between them.
+ */
+#include "simdkernels.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include "vector.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PQ_SIMD_X86 1
+#endif
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static int minIndexScalar(const int* values, int n) {
+    int smallest = 0;
+    for (int i = 1; i < n; i++) {
+        if (values[i] < values[smallest])
+            smallest = i;
+    }
+    return smallest;
+}
+
+static int lowerBoundScalar(const int* values, int n, int key) {
+    int low = 0;
+    int high = n;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (values[mid] > key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+#ifdef PQ_SIMD_X86
+
+/* Reduces the four lanes of v to their minimum, in every lane. */
+__attribute__((target("sse4.1")))
+static __m128i horizontalMin(__m128i v) {
+    v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+/*
+ * Finds the minimum value a vector at a time, then the first index that
+ * holds it. The values past the last whole vector are handled one by one.
+ */
+__attribute__((target("sse4.1")))
+static int minIndexSSE41(const int* values, int n) {
+    if (n < 4) return minIndexScalar(values, n);
+    __m128i best = _mm_loadu_si128((const __m128i*) values);
+    int whole = n & ~3;
+    for (int i = 4; i < whole; i += 4) {
+        best = _mm_min_epi32(best, _mm_loadu_si128((const __m128i*) (values + i)));
+    }
+    int minValue = _mm_cvtsi128_si32(horizontalMin(best));
+    for (int i = whole; i < n; i++) {
+        minValue = min(minValue, values[i]);
+    }
+    __m128i target = _mm_set1_epi32(minValue);
+    for (int i = 0; i < whole; i += 4) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (values + i)), target);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    int i = whole;
+    while (values[i] != minValue) i++;
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int minIndexAVX2(const int* values, int n) {
+    if (n < 8) return minIndexSSE41(values, n);
+    __m256i best = _mm256_loadu_si256((const __m256i*) values);
+    int whole = n & ~7;
+    for (int i = 8; i < whole; i += 8) {
+        best = _mm256_min_epi32(best, _mm256_loadu_si256((const __m256i*) (values + i)));
+    }
+    __m128i half = _mm_min_epi32(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    int minValue = _mm_cvtsi128_si32(horizontalMin(half));
+    for (int i = whole; i < n; i++) {
+        minValue = min(minValue, values[i]);
+    }
+    __m256i target = _mm256_set1_epi32(minValue);
+    for (int i = 0; i < whole; i += 8) {
+        __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (values + i)), target);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    int i = whole;
+    while (values[i] != minValue) i++;
+    return i;
+}
+
+/*
+ * In a decreasing array the values greater than key are a prefix, so once
+ * the binary search has narrowed the range down to [low, high), the answer
+ * is low plus the number of values greater than key in the range.
+ */
+__attribute__((target("sse4.1")))
+static int lowerBoundSSE41(const int* values, int n, int key) {
+    int low = 0;
+    int high = n;
+    while (high - low > 32) {
+        int mid = low + (high - low) / 2;
+        if (values[mid] > key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    __m128i keys = _mm_set1_epi32(key);
+    int count = 0;
+    int i = low;
+    for (; i + 4 <= high; i += 4) {
+        __m128i greater = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*) (values + i)), keys);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(greater)));
+    }
+    for (; i < high; i++) {
+        count += values[i] > key;
+    }
+    return low + count;
+}
+
+__attribute__((target("avx2")))
+static int lowerBoundAVX2(const int* values, int n, int key) {
+    int low = 0;
+    int high = n;
+    while (high - low > 64) {
+        int mid = low + (high - low) / 2;
+        if (values[mid] > key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    __m256i keys = _mm256_set1_epi32(key);
+    int count = 0;
+    int i = low;
+    for (; i + 8 <= high; i += 8) {
+        __m256i greater = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) (values + i)), keys);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(greater)));
+    }
+    for (; i < high; i++) {
+        count += values[i] > key;
+    }
+    return low + count;
+}
+
+#endif // PQ_SIMD_X86
+
+SimdLevel bestSimdLevel() {
+#ifdef PQ_SIMD_X86
+    static const SimdLevel best = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2
+            : __builtin_cpu_supports("sse4.1") ? SimdLevel::SSE41
+            : SimdLevel::Scalar;
+    return best;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE41: return "SSE4.1";
+        default: return "scalar";
+    }
+}
+
+/*
+ * Asking for a level the CPU doesn't support gets the best one it does.
+ */
+int minIndex(const int* values, int n, SimdLevel level) {
+#ifdef PQ_SIMD_X86
+    level = min(level, bestSimdLevel());
+    if (level == SimdLevel::AVX2) return minIndexAVX2(values, n);
+    if (level == SimdLevel::SSE41) return minIndexSSE41(values, n);
+#endif
+    return minIndexScalar(values, n);
+}
+
+int lowerBoundDescending(const int* values, int n, int key, SimdLevel level) {
+#ifdef PQ_SIMD_X86
+    level = min(level, bestSimdLevel());
+    if (level == SimdLevel::AVX2) return lowerBoundAVX2(values, n, key);
+    if (level == SimdLevel::SSE41) return lowerBoundSSE41(values, n, key);
+#endif
+    return lowerBoundScalar(values, n, key);
+}
+
+/*
+ * The best kernel is looked up once, and every later call goes straight
+ * through the pointer.
+ */
+int minIndex(const int* values, int n) {
+#ifdef PQ_SIMD_X86
+    static int (* const kernel)(const int*, int) = bestSimdLevel() == SimdLevel::AVX2 ? minIndexAVX2
+            : bestSimdLevel() == SimdLevel::SSE41 ? minIndexSSE41
+            : minIndexScalar;
+    return kernel(values, n);
+#else
+    return minIndexScalar(values, n);
+#endif
+}
+
+int lowerBoundDescending(const int* values, int n, int key) {
+#ifdef PQ_SIMD_X86
+    static int (* const kernel)(const int*, int, int) = bestSimdLevel() == SimdLevel::AVX2 ? lowerBoundAVX2
+            : bestSimdLevel() == SimdLevel::SSE41 ? lowerBoundSSE41
+            : lowerBoundScalar;
+    return kernel(values, n, key);
+#else
+    return lowerBoundScalar(values, n, key);
+#endif
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+static const SimdLevel kAllLevels[] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 };
+
+STUDENT_TEST("minIndex finds the first smallest value at every level") {
+    for (SimdLevel level : kAllLevels) {
+        for (int n = 1; n <= 40; n++) {
+            for (int trial = 0; trial < 20; trial++) {
+                vector<int> values(n);
+                for (int& value : values) {
+                    value = randomInteger(-5, 5);
+                }
+                if (trial == 0) values[n - 1] = INT_MIN;
+                int expected = min_element(values.begin(), values.end()) - values.begin();
+                EXPECT_EQUAL(minIndex(values.data(), n, level), expected);
+                EXPECT_EQUAL(minIndex(values.data(), n), expected);
+            }
+        }
+    }
+}
+
+STUDENT_TEST("lowerBoundDescending matches a binary search at every level") {
+    for (SimdLevel level : kAllLevels) {
+        for (int n : { 0, 1, 3, 8, 31, 64, 65, 200, 5000 }) {
+            vector<int> values(n);
+            for (int& value : values) {
+                value = randomInteger(-100, 100);
+            }
+            values.push_back(INT_MAX);
+            values.push_back(INT_MIN);
+            sort(values.begin(), values.end(), greater<int>());
+            for (int key : { INT_MIN, -101, -50, 0, 0, 17, 100, INT_MAX }) {
+                int expected = lowerBoundScalar(values.data(), values.size(), key);
+                EXPECT_EQUAL(lowerBoundDescending(values.data(), values.size(), key, level), expected);
+                EXPECT_EQUAL(lowerBoundDescending(values.data(), values.size(), key), expected);
+            }
+        }
+    }
+}
+
+/* Runs minIndex over every group of width values in the array, as bubbling down a width-ary heap would. */
+static long long minOfGroups(const vector<int>& values, int width, SimdLevel level) {
+    long long total = 0;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i + width <= (int) values.size(); i += width) {
+            total += minIndex(values.data() + i, width, level);
+        }
+    }
+    return total;
+}
+
+/* Looks up every key in a decreasing array. */
+static long long lowerBounds(const vector<int>& values, const vector<int>& keys, SimdLevel level) {
+    long long total = 0;
+    for (int key : keys) {
+        total += lowerBoundDescending(values.data(), values.size(), key, level);
+    }
+    return total;
+}
+
+STUDENT_TEST("SIMD kernel microbenchmarks, each level") {
+    vector<int> values(1 << 20);
+    for (int& value : values) {
+        value = randomInteger(0, 1000000);
+    }
+    for (int width : { 4, 8 }) {
+        for (SimdLevel level : kAllLevels) {
+            if (level > bestSimdLevel()) continue;
+            TIME_OPERATION(width, minOfGroups(values, width, level));
+        }
+    }
+
+    vector<int> keys(1000000);
+    for (int& key : keys) {
+        key = randomInteger(0, 1000000);
+    }
+    for (int n = 64; n <= 65536; n *= 32) {
+        vector<int> sorted(values.begin(), values.begin() + n);
+        sort(sorted.begin(), sorted.end(), greater<int>());
+        for (SimdLevel level : kAllLevels) {
+            if (level > bestSimdLevel()) continue;
+            TIME_OPERATION(n, lowerBounds(sorted, keys, level));
+        }
+    }
+}
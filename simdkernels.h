@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Small search kernels over packed int priority arrays, with AVX2 and
+ * SSE4.1 versions picked at run time by what the CPU supports, and a
+ * scalar version for every other machine. Each kernel also has a version
+ * that takes the level to use, for tests and benchmarks.
+ */
+
+/**
+ * The instruction set levels the kernels come in, from slowest to fastest.
+ */
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+/**
+ * Returns the fastest level this CPU supports.
+ */
+SimdLevel bestSimdLevel();
+
+/**
+ * Returns a name for the level, such as "AVX2".
+ */
+const char* simdLevelName(SimdLevel level);
+
+/**
+ * Returns the index of the first smallest of the n values. n must be at
+ * least 1. Eight values, such as the children of a node in an 8-ary heap,
+ * take one AVX2 min and compare.
+ */
+int minIndex(const int* values, int n);
+int minIndex(const int* values, int n, SimdLevel level);
+
+/**
+ * For n values sorted in decreasing order, returns the first index whose
+ * value is less than or equal to key, or n if there is none. A binary
+ * search narrows the range down to a few vectors' worth, and the values
+ * greater than key in what is left are then counted a vector at a time.
+ */
+int lowerBoundDescending(const int* values, int n, int key);
+int lowerBoundDescending(const int* values, int n, int key, SimdLevel level);
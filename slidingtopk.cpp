@@ -0,0 +1,251 @@
+/* A sliding window over a stream that answers for the best k records in
+ * it, with records expiring by count or by timestamp.
+ */
+#include "slidingtopk.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include <algorithm>
+#include <climits>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+SlidingTopK::SlidingTopK(int k, long long windowSize, Expiry expiry) : _candidates(&_nodePool) {
+    if (k < 0) {
+        error("Cannot keep a negative number of records");
+    }
+    if (windowSize < 1) {
+        error("The window must be at least one long");
+    }
+    _k = k;
+    _windowSize = windowSize;
+    _expiry = expiry;
+    _now = LLONG_MIN;
+    _nextSeq = 0;
+}
+
+/*
+ * The tree has to give its nodes back to the pool before the pool goes
+ * away, which the member order takes care of.
+ */
+SlidingTopK::~SlidingTopK() {}
+
+void SlidingTopK::add(const DataPoint& elem) {
+    if (_expiry == Expiry::Time) {
+        error("A time window needs a timestamp for every record");
+    }
+    add(elem, _now);
+}
+
+/*
+ * The new record outranks exactly the candidates with a smaller priority,
+ * which are the ones after it in the tree. A candidate of equal priority
+ * is older, so it still ranks above the new record.
+ */
+void SlidingTopK::add(const DataPoint& elem, long long timestamp) {
+    if (timestamp < _now) {
+        error("Records must be added in timestamp order");
+    }
+    _now = timestamp;
+    Arrival arrival = { elem.priority, _nextSeq++, timestamp };
+    _window.push_back(arrival);
+    if (_k > 0) {
+        auto firstBelow = _candidates.upper_bound(Arrival{ elem.priority, LLONG_MAX, 0 });
+        auto added = _candidates.emplace_hint(firstBelow, Candidate{ elem.priority, arrival.seq, elem.label, 0 });
+        for (auto it = next(added); it != _candidates.end(); ) {
+            if (++it->numOutranking >= _k) {
+                it = _candidates.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    expire();
+}
+
+void SlidingTopK::advanceTime(long long now) {
+    if (_expiry == Expiry::Count) {
+        return;
+    }
+    if (now < _now) {
+        error("Time cannot go backward");
+    }
+    _now = now;
+    expire();
+}
+
+/*
+ * Drops records off the front of the deque, and out of the tree if they
+ * are still candidates, for as long as the oldest one is outside the
+ * window.
+ */
+void SlidingTopK::expire() {
+    while (!_window.empty()) {
+        const Arrival& oldest = _window.front();
+        bool expired = _expiry == Expiry::Count ? (long long) _window.size() > _windowSize
+                                                : _now - oldest.timestamp >= _windowSize;
+        if (!expired)
+            break;
+        auto it = _candidates.find(oldest);
+        if (it != _candidates.end()) {
+            _candidates.erase(it);
+        }
+        _window.pop_front();
+    }
+}
+
+Vector<DataPoint> SlidingTopK::topK() const {
+    Vector<DataPoint> result;
+    for (auto it = _candidates.begin(); it != _candidates.end() && result.size() < _k; ++it) {
+        result.add({ it->label, it->priority });
+    }
+    return result;
+}
+
+int SlidingTopK::size() const {
+    return _window.size();
+}
+
+int SlidingTopK::numCandidates() const {
+    return _candidates.size();
+}
+
+bool SlidingTopK::isEmpty() const {
+    return _window.empty();
+}
+
+void SlidingTopK::clear() {
+    _candidates.clear();
+    _window.clear();
+    _nextSeq = 0;
+    _now = LLONG_MIN;
+}
+
+void SlidingTopK::validateInternalState() {
+    if (_expiry == Expiry::Count && (long long) _window.size() > _windowSize) {
+        error("More records than the window holds");
+    }
+    if (_expiry == Expiry::Time && !_window.empty() && _now - _window.front().timestamp >= _windowSize) {
+        error("An expired record is still in the window");
+    }
+
+    int numExpected = 0;
+    for (size_t i = 0; i < _window.size(); i++) {
+        int numOutranking = 0;
+        for (size_t j = i + 1; j < _window.size(); j++) {
+            if (_window[j].priority > _window[i].priority)
+                numOutranking++;
+        }
+        auto it = _candidates.find(_window[i]);
+        if (numOutranking < _k) {
+            numExpected++;
+            if (it == _candidates.end()) {
+                error("Record at position " + longToString(_window[i].seq) + " is missing from the candidates");
+            }
+            if (it->numOutranking != numOutranking) {
+                error("Candidate at position " + longToString(_window[i].seq) + " has the wrong count");
+            }
+        } else if (it != _candidates.end()) {
+            error("Record at position " + longToString(_window[i].seq) + " can't make the top k but is a candidate");
+        }
+    }
+    if ((int) _candidates.size() != numExpected) {
+        error("The candidates include records that are not in the window");
+    }
+}
+
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+/* The best k of the records from start on, by sorting them. */
+static Vector<DataPoint> bruteForceTopK(const Vector<DataPoint>& records, int start, int k) {
+    Vector<DataPoint> live;
+    for (int i = start; i < records.size(); i++) {
+        live.add(records[i]);
+    }
+    stable_sort(live.begin(), live.end(), [](const DataPoint& a, const DataPoint& b) {
+        return a.priority > b.priority;
+    });
+    Vector<DataPoint> result;
+    for (int i = 0; i < min(k, live.size()); i++) {
+        result.add(live[i]);
+    }
+    return result;
+}
+
+STUDENT_TEST("SlidingTopK by count matches sorting the last N records") {
+    for (int k : { 0, 1, 5 }) {
+        SlidingTopK window(k, 50);
+        Vector<DataPoint> records;
+        for (int i = 0; i < 400; i++) {
+            records.add({ "r" + integerToString(i), randomInteger(0, 20) });
+            window.add(records[i]);
+            window.validateInternalState();
+            EXPECT_EQUAL(window.size(), min(i + 1, 50));
+            EXPECT_EQUAL(window.topK(), bruteForceTopK(records, max(0, i + 1 - 50), k));
+        }
+        window.clear();
+        EXPECT(window.isEmpty());
+        EXPECT(window.topK().isEmpty());
+    }
+
+    // the clock means nothing in count mode, even after a timestamped add
+    SlidingTopK window(1, 2);
+    window.add({ "a", 1 }, 100);
+    EXPECT_NO_ERROR(window.advanceTime(5));
+    EXPECT_EQUAL(window.size(), 1);
+}
+
+STUDENT_TEST("SlidingTopK by time expires records as the clock moves") {
+    SlidingTopK window(3, 100, SlidingTopK::Expiry::Time);
+    Vector<DataPoint> records;
+    Vector<long long> stamps;
+    long long now = 1000;
+    for (int i = 0; i < 500; i++) {
+        now += randomInteger(0, 30);
+        records.add({ "r" + integerToString(i), randomInteger(-10, 10) });
+        stamps.add(now);
+        window.add(records[i], now);
+        window.validateInternalState();
+
+        int start = 0;
+        while (now - stamps[start] >= 100) start++;
+        EXPECT_EQUAL(window.size(), i + 1 - start);
+        EXPECT_EQUAL(window.topK(), bruteForceTopK(records, start, 3));
+    }
+
+    window.advanceTime(now + 99);
+    EXPECT(!window.isEmpty());
+    window.advanceTime(now + 100);
+    EXPECT(window.isEmpty());
+    window.validateInternalState();
+
+    EXPECT_ERROR(window.add({ "late", 1 }, now));
+    EXPECT_ERROR(window.advanceTime(now));
+    EXPECT_ERROR(window.add({ "no time", 1 }));
+    EXPECT_ERROR(SlidingTopK(-1, 10));
+    EXPECT_ERROR(SlidingTopK(1, 0));
+}
+
+/* Adds the records to the window one at a time and returns the best priority at the end. */
+static int ingest(SlidingTopK& window, const Vector<DataPoint>& records) {
+    for (const DataPoint& record : records) {
+        window.add(record);
+    }
+    return window.topK()[0].priority;
+}
+
+STUDENT_TEST("SlidingTopK time trial, one million records into ever larger full windows") {
+    int numRecords = 1000000;
+    Vector<DataPoint> records;
+    for (int i = 0; i < numRecords; i++) {
+        records.add({ "", randomInteger(0, 1 << 30) });
+    }
+    for (int windowSize = 1000; windowSize <= 4096000; windowSize *= 4) {
+        SlidingTopK window(100, windowSize);
+        for (int i = 0; i < windowSize; i++) {
+            window.add({ "", randomInteger(0, 1 << 30) });
+        }
+        TIME_OPERATION(windowSize, ingest(window, records));
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include "testing/MemoryDiagnostics.h"
+#include <deque>
+#include <memory_resource>
+#include <set>
+#include <string>
+
+/**
+ * Keeps the k elements with the largest priority values among the most
+ * recent records of an unbounded stream, for answering "top k over the
+ * last N records" continuously rather than once at the end of a stream.
+ *
+ * In count mode the window is the last windowSize records added. In time
+ * mode every record comes with a timestamp, and the window is the records
+ * whose timestamps are less than windowSize before the latest one.
+ *
+ * A record that k newer records outrank can never be in the top k again,
+ * since those k records stay in the window at least as long as it does.
+ * So only the others, the window's k-skyband, are kept in full, in a
+ * balanced tree ordered best first, each with a count of the newer
+ * records that outrank it. A new record adds one to the count of every
+ * candidate it outranks and drops the ones that reach k. Each candidate
+ * is counted at most k times before it is dropped, so adding a record
+ * costs O(k + log S) amortized for a skyband of S candidates, however
+ * big the window is. On random input S is about k ln(N / k) for a window
+ * of N records; on decreasing input no record is ever outranked and S is
+ * N. The tree's nodes come from a pool that recycles those of dropped
+ * candidates.
+ *
+ * Every live record also has a 24-byte entry in a deque in the order it
+ * arrived, which is how it is found again when it expires. topK() just
+ * walks the first k candidates in O(k).
+ *
+ * Ties are broken as in topK: of two records with equal priority, the one
+ * added first ranks higher.
+ */
+class SlidingTopK {
+public:
+    enum class Expiry { Count, Time };
+
+    /**
+     * Creates an empty window that answers for the best k records. In
+     * count mode it holds the last windowSize records, and in time mode
+     * the records less than windowSize time units older than the newest.
+     *
+     * If k is negative or windowSize is less than one, this function
+     * calls error().
+     */
+    SlidingTopK(int k, long long windowSize, Expiry expiry = Expiry::Count);
+
+    /**
+     * Cleans up all memory allocated by the window.
+     */
+    ~SlidingTopK();
+
+    /**
+     * Adds a record in count mode, expiring the oldest record if the
+     * window was full.
+     *
+     * In time mode, this function calls error().
+     */
+    void add(const DataPoint& element);
+
+    /**
+     * Adds a record with the given timestamp, expiring every record that
+     * has fallen out of the window. In count mode the timestamp only has
+     * to be in order.
+     *
+     * If the timestamp is before the last one added, this function calls
+     * error().
+     */
+    void add(const DataPoint& element, long long timestamp);
+
+    /**
+     * Moves the clock forward to now without adding a record, expiring
+     * every record that has fallen out of the window by then. Does nothing
+     * in count mode.
+     *
+     * If now is before the last timestamp seen, this function calls error().
+     */
+    void advanceTime(long long now);
+
+    /**
+     * Returns the best k live records in decreasing order of priority,
+     * with ties in the order they were added. Fewer than k come back if
+     * the window holds fewer.
+     */
+    Vector<DataPoint> topK() const;
+
+    /**
+     * Returns the number of live records in the window.
+     */
+    int size() const;
+
+    /**
+     * Returns the number of records kept in full, the k-skyband.
+     */
+    int numCandidates() const;
+
+    /**
+     * Returns whether the window holds no records.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Forgets every record and resets the clock.
+     */
+    void clear();
+
+    /**
+     * Confirms that the candidates are exactly the live records that fewer
+     * than k newer ones outrank, with the right counts, and calls error()
+     * if problems are found. Takes time quadratic in the window size, so
+     * it is only for tests.
+     */
+    void validateInternalState();
+
+private:
+    /* A live record, as the deque keeps it: enough to find its candidate. */
+    struct Arrival {
+        int priority;
+        long long seq;          // position in the stream
+        long long timestamp;
+    };
+
+    /* A record of the skyband. Only numOutranking changes once it is in the tree. */
+    struct Candidate {
+        int priority;
+        long long seq;
+        std::string label;
+        mutable int numOutranking;  // newer records with a larger priority
+    };
+
+    /* Orders the tree best first: larger priority, then earlier position.
+     * Works on Arrivals too, so they can be looked up without a label.
+     */
+    struct RanksAbove {
+        using is_transparent = void;
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const {
+            if (a.priority != b.priority)
+                return a.priority > b.priority;
+            return a.seq < b.seq;
+        }
+    };
+
+    int _k;                         // number of records topK returns
+    long long _windowSize;          // records or time units in the window
+    Expiry _expiry;                 // what windowSize counts
+    long long _now;                 // latest timestamp seen
+    long long _nextSeq;             // position in the stream of the next record
+    std::deque<Arrival> _window;    // live records, oldest first
+    std::pmr::unsynchronized_pool_resource _nodePool;       // recycles tree nodes
+    std::pmr::set<Candidate, RanksAbove> _candidates;       // the skyband, best first
+
+    void expire();
+
+    /* Weird C++isms: You're not allowed to copy or assign windows. */
+    SlidingTopK(const SlidingTopK &) = delete;
+    void operator=(const SlidingTopK &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(SlidingTopK);
+};
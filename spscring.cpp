@@ -0,0 +1,61 @@
+/* Tests for the SpscRing template. The implementation lives in spscring.h
+ * since the element type is a template parameter.
+ */
+#include "spscring.h"
+#include "datapoint.h"
+#include "strlib.h"
+#include <string>
+#include <thread>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+STUDENT_TEST("SpscRing is first in, first out and refuses to overfill") {
+    SpscRing<int> ring(5);
+    EXPECT_EQUAL(ring.capacity(), 8);
+    int out = -1;
+    EXPECT(!ring.tryPop(out));
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 8; i++) {
+            EXPECT(ring.tryPush(100 * round + i));
+        }
+        EXPECT(!ring.tryPush(-1));
+        for (int i = 0; i < 8; i++) {
+            EXPECT(ring.tryPop(out));
+            EXPECT_EQUAL(out, 100 * round + i);
+        }
+        EXPECT(!ring.tryPop(out));
+    }
+}
+
+STUDENT_TEST("SpscRing keeps a value it had no room for") {
+    SpscRing<DataPoint> ring(1);
+    EXPECT(ring.tryPush(DataPoint{ "first", 1 }));
+    DataPoint second = { "second, long enough to live outside the string", 2 };
+    EXPECT(!ring.tryPush(std::move(second)));
+    EXPECT_EQUAL(second.label, "second, long enough to live outside the string");
+    EXPECT_EQUAL(ring.pop().label, "first");
+    ring.push(std::move(second));
+    EXPECT_EQUAL(ring.pop().priority, 2);
+}
+
+STUDENT_TEST("SpscRing hands a million values from one thread to another in order") {
+    SpscRing<long long> ring(64);
+    int n = 1000000;
+    thread producer([&]() {
+        for (long long i = 0; i < n; i++) {
+            ring.push(i);
+        }
+        ring.push(-1);
+    });
+    // keeps popping through any mismatch, so that the producer never blocks on a full ring
+    long long expected = 0;
+    int numWrong = 0;
+    for (long long value = ring.pop(); value != -1; value = ring.pop()) {
+        if (value != expected) numWrong++;
+        expected++;
+    }
+    producer.join();
+    EXPECT_EQUAL(numWrong, 0);
+    EXPECT_EQUAL(expected, n);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+/**
+ * A bounded, lock-free queue for passing values from exactly one producer
+ * thread to exactly one consumer thread, such as batches of parsed
+ * records from a reader thread to the thread that selects among them.
+ *
+ * The slots form a ring whose size is a power of two. The producer only
+ * writes the tail index and the consumer only writes the head index, so
+ * neither ever waits on a lock; each index sits on its own cache line
+ * with the owner's cached copy of the other index, so the two threads
+ * only share a line when the ring looks full or empty.
+ *
+ * Calling push or tryPush from more than one thread at a time, or pop or
+ * tryPop from more than one thread at a time, is not allowed.
+ */
+template <typename T>
+class SpscRing {
+public:
+    /**
+     * Creates an empty ring with room for at least capacity values. The
+     * capacity is rounded up to a power of two.
+     */
+    SpscRing(int capacity);
+
+    /**
+     * Cleans up the slots.
+     */
+    ~SpscRing();
+
+    /**
+     * Adds the value at the tail and returns true, or returns false if the
+     * ring is full, in which case the value is left alone. Producer only.
+     */
+    bool tryPush(const T& value);
+    bool tryPush(T&& value);
+
+    /**
+     * Adds the value at the tail, yielding the thread while the ring is
+     * full. Producer only.
+     */
+    void push(T value);
+
+    /**
+     * Moves the value at the head into out and returns true, or returns
+     * false if the ring is empty. Consumer only.
+     */
+    bool tryPop(T& out);
+
+    /**
+     * Removes and returns the value at the head, yielding the thread while
+     * the ring is empty. Consumer only.
+     */
+    T pop();
+
+    /**
+     * Returns the number of values the ring can hold.
+     */
+    int capacity() const;
+
+private:
+    T* _slots;              // ring of capacity slots
+    size_t _mask;           // capacity - 1
+
+    alignas(64) std::atomic<size_t> _tail;  // next slot to push into, written by the producer
+    size_t _headCache;                      // producer's last look at _head
+
+    alignas(64) std::atomic<size_t> _head;  // next slot to pop from, written by the consumer
+    size_t _tailCache;                      // consumer's last look at _tail
+
+    /* Weird C++isms: You're not allowed to copy or assign rings. */
+    SpscRing(const SpscRing &) = delete;
+    void operator=(const SpscRing &) = delete;
+};
+
+/* * * * * * Implementation Below This Point * * * * * */
+
+template <typename T>
+SpscRing<T>::SpscRing(int capacity) {
+    size_t size = 1;
+    while ((int) size < capacity) {
+        size *= 2;
+    }
+    _slots = new T[size];
+    _mask = size - 1;
+    _tail.store(0, std::memory_order_relaxed);
+    _headCache = 0;
+    _head.store(0, std::memory_order_relaxed);
+    _tailCache = 0;
+}
+
+template <typename T>
+SpscRing<T>::~SpscRing() {
+    delete[] _slots;
+}
+
+/*
+ * The slot is written before the release store of the tail, so the
+ * consumer's acquire load of the tail sees the value in it. The head is
+ * only reloaded when the cached copy says the ring is full.
+ */
+template <typename T>
+bool SpscRing<T>::tryPush(T&& value) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _headCache > _mask) {
+        _headCache = _head.load(std::memory_order_acquire);
+        if (tail - _headCache > _mask)
+            return false;
+    }
+    _slots[tail & _mask] = std::move(value);
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscRing<T>::tryPush(const T& value) {
+    return tryPush(T(value));
+}
+
+template <typename T>
+void SpscRing<T>::push(T value) {
+    while (!tryPush(std::move(value))) {
+        std::this_thread::yield();
+    }
+}
+
+/*
+ * The mirror image of tryPush: the value is moved out before the release
+ * store of the head hands the slot back to the producer.
+ */
+template <typename T>
+bool SpscRing<T>::tryPop(T& out) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tailCache) {
+        _tailCache = _tail.load(std::memory_order_acquire);
+        if (head == _tailCache)
+            return false;
+    }
+    out = std::move(_slots[head & _mask]);
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+T SpscRing<T>::pop() {
+    T value;
+    while (!tryPop(value)) {
+        std::this_thread::yield();
+    }
+    return value;
+}
+
+template <typename T>
+int SpscRing<T>::capacity() const {
+    return _mask + 1;
+}
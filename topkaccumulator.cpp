@@ -0,0 +1,311 @@
+/* A bounded min-heap that keeps the k largest elements of a stream. Used by
+ * topK in pqclient.cpp.
+ */
+#include "topkaccumulator.h"
+#include "error.h"
+#include "random.h"
+#include "strlib.h"
+#include <algorithm>
+#include <climits>
+#include "testing/SimpleTest.h"
+using namespace std;
+
+static const int INITIAL_CAPACITY = 10;
+
+/*
+ * The array starts small and grows up to k as elements arrive, so asking
+ * for a huge k out of a short stream doesn't allocate k slots.
+ */
+TopKAccumulator::TopKAccumulator(int k) {
+    _k = max(k, 0);
+    _numAllocated = min(_k, INITIAL_CAPACITY);
+    _entries = new Entry[_numAllocated];
+    _numFilled = 0;
+    _numOffered = 0;
+    PQ_COUNT(_stats.bytesAllocated += _numAllocated * (long long) sizeof(Entry));
+}
+
+TopKAccumulator::~TopKAccumulator() {
+    delete[] _entries;
+}
+
+void TopKAccumulator::offer(const DataPoint& elem) {
+    if (wouldAccept(elem.priority)) {
+        add({ elem, _numOffered });
+    }
+    _numOffered++;
+}
+
+void TopKAccumulator::offer(DataPoint&& elem) {
+    if (wouldAccept(elem.priority)) {
+        add({ std::move(elem), _numOffered });
+    }
+    _numOffered++;
+}
+
+void TopKAccumulator::offerBatch(const Vector<DataPoint>& elems) {
+    for (const DataPoint& elem : elems) {
+        offer(elem);
+    }
+}
+
+/*
+ * Entries from other keep their own positions, so unlike a fresh offer
+ * they can win a tie against the root.
+ */
+void TopKAccumulator::merge(const TopKAccumulator& other) {
+    for (int i = 0; i < other._numFilled; i++) {
+        const Entry& entry = other._entries[i];
+        PQ_COUNT(_stats.comparisons += (_numFilled >= _k && _k > 0));
+        if (_numFilled < _k || (_k > 0 && ranksBelow(_entries[0], entry))) {
+            add(Entry(entry));
+        }
+    }
+    _numOffered = max(_numOffered, other._numOffered);
+}
+
+void TopKAccumulator::setNextSequence(long long seq) {
+    _numOffered = seq;
+}
+
+/*
+ * Every new offer comes after everything already kept, so it only wins a
+ * tie if there is room left. Otherwise it has to beat the root outright.
+ */
+bool TopKAccumulator::wouldAccept(int priority) const {
+    if (_numFilled < _k)
+        return true;
+    PQ_COUNT(_stats.comparisons += (_k > 0));
+    return _k > 0 && priority > _entries[0].point.priority;
+}
+
+long long TopKAccumulator::threshold() const {
+    if (_numFilled < _k)
+        return LLONG_MIN;
+    if (_k == 0)
+        return LLONG_MAX;
+    return _entries[0].point.priority;
+}
+
+/*
+ * Sorts a copy of the kept entries from best to worst. This is O(k log k)
+ * and leaves the accumulator untouched so more offers can follow.
+ */
+Vector<DataPoint> TopKAccumulator::results() const {
+    Vector<Entry> sorted;
+    for (int i = 0; i < _numFilled; i++) {
+        sorted.add(_entries[i]);
+    }
+    sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) {
+        return ranksBelow(b, a);
+    });
+    Vector<DataPoint> result;
+    for (Entry& entry : sorted) {
+        result.add(std::move(entry.point));
+    }
+    return result;
+}
+
+PQStats TopKAccumulator::stats() const {
+    return _stats;
+}
+
+void TopKAccumulator::resetStats() {
+    _stats = PQStats();
+}
+
+int TopKAccumulator::size() const {
+    return _numFilled;
+}
+
+void TopKAccumulator::clear() {
+    _numFilled = 0;
+    _numOffered = 0;
+}
+
+void TopKAccumulator::validateInternalState() {
+    if (_numFilled > _numAllocated) error("Too many elements in not enough space!");
+    if (_numFilled > _k) error("Kept more than k elements!");
+
+    for (int i = 1; i < size(); i++) {
+        if (ranksBelow(_entries[i], _entries[(i - 1) / 2]))
+            error("Array elements out of order at index " + integerToString(i));
+    }
+}
+
+/*
+ * a ranks below b if it has a smaller priority, or the same priority and
+ * was offered later.
+ */
+bool TopKAccumulator::ranksBelow(const Entry& a, const Entry& b) {
+    if (a.point.priority != b.point.priority)
+        return a.point.priority < b.point.priority;
+    return a.seq > b.seq;
+}
+
+/*
+ * Adds the entry while there is room, and otherwise replaces the root,
+ * which callers have already checked the entry outranks.
+ */
+void TopKAccumulator::add(Entry&& entry) {
+    PQ_COUNT(_stats.moves++);
+    if (_numFilled < _k) {
+        ensureCapacity(_numFilled + 1);
+        _entries[_numFilled] = std::move(entry);
+        _numFilled++;
+        bubbleUp(_numFilled - 1);
+    } else {
+        _entries[0] = std::move(entry);
+        bubbleDown(0);
+    }
+}
+
+void TopKAccumulator::bubbleUp(int index) {
+    Entry entry = std::move(_entries[index]);
+    PQ_COUNT(int depth = 0);
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        PQ_COUNT(_stats.comparisons++);
+        if (!ranksBelow(entry, _entries[parent]))
+            break;
+        _entries[index] = std::move(_entries[parent]);
+        index = parent;
+        PQ_COUNT(depth++);
+    }
+    _entries[index] = std::move(entry);
+    PQ_COUNT(_stats.moves += depth + 2);
+    PQ_COUNT(_stats.recordSift(depth));
+}
+
+void TopKAccumulator::bubbleDown(int index) {
+    Entry entry = std::move(_entries[index]);
+    PQ_COUNT(int depth = 0);
+    while (2 * index + 1 < _numFilled) {
+        int child = 2 * index + 1;
+        PQ_COUNT(_stats.comparisons += (child + 1 < _numFilled) + 1);
+        if (child + 1 < _numFilled && ranksBelow(_entries[child + 1], _entries[child]))
+            child++;
+        if (!ranksBelow(_entries[child], entry))
+            break;
+        _entries[index] = std::move(_entries[child]);
+        index = child;
+        PQ_COUNT(depth++);
+    }
+    _entries[index] = std::move(entry);
+    PQ_COUNT(_stats.moves += depth + 2);
+    PQ_COUNT(_stats.recordSift(depth));
+}
+
+/*
+ * Doubles the array, but never past k.
+ */
+void TopKAccumulator::ensureCapacity(int numNeeded) {
+    if (numNeeded <= _numAllocated)
+        return;
+    int newAllocated = min(max(_numAllocated * 2, numNeeded), _k);
+    Entry* newEntries = new Entry[newAllocated];
+    for (int i = 0; i < _numFilled; i++) {
+        newEntries[i] = std::move(_entries[i]);
+    }
+    PQ_COUNT(_stats.reallocations++);
+    PQ_COUNT(_stats.bytesAllocated += newAllocated * (long long) sizeof(Entry));
+    PQ_COUNT(_stats.moves += _numFilled);
+    delete[] _entries;
+    _entries = newEntries;
+    _numAllocated = newAllocated;
+}
+
+/* * * * * * Test Cases Below This Point * * * * * */
+
+STUDENT_TEST("TopKAccumulator keeps the k largest in decreasing order") {
+    TopKAccumulator best(3);
+    Vector<DataPoint> input = {
+        { "R", 4 }, { "A", 5 }, { "B", 3 }, { "K", 7 }, { "G", 2 },
+        { "V", 9 }, { "T", 1 }, { "O", 8 }, { "S", 6 } };
+    for (const DataPoint& dp : input) {
+        best.offer(dp);
+        best.validateInternalState();
+    }
+    Vector<DataPoint> expected = { { "V", 9 }, { "O", 8 }, { "K", 7 } };
+    EXPECT_EQUAL(best.results(), expected);
+    EXPECT_EQUAL(best.size(), 3);
+
+    // results doesn't disturb the accumulator
+    best.offer({ "Z", 100 });
+    expected = { { "Z", 100 }, { "V", 9 }, { "O", 8 } };
+    EXPECT_EQUAL(best.results(), expected);
+}
+
+STUDENT_TEST("TopKAccumulator breaks ties by offer order") {
+    TopKAccumulator best(4);
+    best.offerBatch({ { "a", 1 }, { "b", 2 }, { "c", 1 }, { "d", 2 }, { "e", 1 }, { "f", 2 }, { "g", 3 } });
+    best.validateInternalState();
+    Vector<DataPoint> expected = { { "g", 3 }, { "b", 2 }, { "d", 2 }, { "f", 2 } };
+    EXPECT_EQUAL(best.results(), expected);
+
+    TopKAccumulator firstTwo(2);
+    firstTwo.offerBatch({ { "a", 5 }, { "b", 5 }, { "c", 5 } });
+    expected = { { "a", 5 }, { "b", 5 } };
+    EXPECT_EQUAL(firstTwo.results(), expected);
+}
+
+STUDENT_TEST("TopKAccumulator with fewer elements than k, k of zero, and clear") {
+    TopKAccumulator best(1000000);
+    best.offerBatch({ { "x", 2 }, { "y", 1 } });
+    Vector<DataPoint> expected = { { "x", 2 }, { "y", 1 } };
+    EXPECT_EQUAL(best.results(), expected);
+    best.clear();
+    EXPECT_EQUAL(best.size(), 0);
+    EXPECT(best.results().isEmpty());
+
+    TopKAccumulator none(0);
+    none.offer({ "x", 2 });
+    EXPECT(!none.wouldAccept(100));
+    EXPECT_EQUAL(none.size(), 0);
+    EXPECT(none.results().isEmpty());
+}
+
+STUDENT_TEST("Merging numbered pieces matches one accumulator over the whole stream") {
+    Vector<DataPoint> input;
+    for (int i = 0; i < 2000; i++) {
+        input.add({ integerToString(i), randomInteger(0, 50) });
+    }
+    TopKAccumulator whole(100);
+    whole.offerBatch(input);
+
+    TopKAccumulator first(100);
+    TopKAccumulator second(100);
+    second.setNextSequence(1000);
+    for (int i = 0; i < 2000; i++) {
+        if (i < 1000) {
+            first.offer(input[i]);
+        } else {
+            second.offer(input[i]);
+        }
+    }
+    // merge in the "wrong" order, the positions still decide ties
+    TopKAccumulator merged(100);
+    merged.merge(second);
+    merged.merge(first);
+    merged.validateInternalState();
+    EXPECT_EQUAL(merged.results(), whole.results());
+}
+
+STUDENT_TEST("TopKAccumulator matches sorting on random input") {
+    for (int k : { 1, 10, 500, 5000 }) {
+        TopKAccumulator best(k);
+        Vector<int> sorted;
+        for (int i = 0; i < 10000; i++) {
+            int weight = randomInteger(0, 1000);
+            sorted.add(weight);
+            best.offer({ "", weight });
+        }
+        best.validateInternalState();
+        sort(sorted.begin(), sorted.end(), greater<int>());
+        Vector<DataPoint> result = best.results();
+        EXPECT_EQUAL(result.size(), k);
+        for (int i = 0; i < k; i++) {
+            EXPECT_EQUAL(result[i].priority, sorted[i]);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "datapoint.h"
+#include "vector.h"
+#include "pqstats.h"
+#include "testing/MemoryDiagnostics.h"
+
+/**
+ * Keeps the k elements with the largest priority values out of a stream
+ * of offered elements, using a bounded min-heap. The heap root is the
+ * weakest element kept so far, so an offer that can't make the cut is
+ * rejected with a single comparison and one that can replaces the root
+ * in O(log k) time. Streaming N elements costs O(N log k) overall.
+ *
+ * Elements with equal priority are ranked by the order they were offered
+ * in: the earlier one wins a spot in the top k and comes first in the
+ * results.
+ */
+class TopKAccumulator {
+public:
+    /**
+     * Creates an accumulator that keeps the best k elements offered.
+     * A k of zero or less keeps nothing.
+     */
+    TopKAccumulator(int k);
+
+    /**
+     * Cleans up all memory allocated by this accumulator.
+     */
+    ~TopKAccumulator();
+
+    /**
+     * Offers one element. It is kept if it ranks among the best k seen so
+     * far, possibly pushing out the weakest one currently kept. The const
+     * version only copies the element if it is kept.
+     */
+    void offer(const DataPoint& element);
+    void offer(DataPoint&& element);
+
+    /**
+     * Offers every element of the vector, in order.
+     */
+    void offerBatch(const Vector<DataPoint>& elements);
+
+    /**
+     * Offers every element kept by other, each ranked by the position it
+     * was originally offered at. Merging the accumulators of the pieces
+     * of a stream gives the same top k as offering the whole stream to
+     * one accumulator, as long as each piece was numbered with
+     * setNextSequence so that its positions follow the earlier pieces.
+     */
+    void merge(const TopKAccumulator& other);
+
+    /**
+     * Numbers the next offer as position seq in the stream, with later
+     * offers following on from there. Offers are assumed to come after
+     * every element already kept.
+     */
+    void setNextSequence(long long seq);
+
+    /**
+     * Returns whether an element with this priority, offered now, would
+     * be kept. Callers can use it to skip building DataPoints that are
+     * going to be rejected anyway.
+     */
+    bool wouldAccept(int priority) const;
+
+    /**
+     * Returns the priority a new offer has to beat to be kept: LLONG_MIN
+     * while there is room, LLONG_MAX if k is zero, and otherwise the
+     * priority of the weakest element kept. wouldAccept(p) is the same as
+     * p > threshold(). The threshold never goes down as offers are made,
+     * so another thread can be handed it to throw records away early.
+     */
+    long long threshold() const;
+
+    /**
+     * Returns the kept elements in decreasing order of priority, with
+     * ties in the order they were offered.
+     */
+    Vector<DataPoint> results() const;
+
+    /**
+     * Returns the number of elements currently kept, which is at most k.
+     */
+    int size() const;
+
+    /**
+     * Forgets all offered elements.
+     */
+    void clear();
+
+    /**
+     * Returns the counts of the work this accumulator has done since it
+     * was created or since the last resetStats(), including the
+     * comparisons made by wouldAccept. They are only counted in builds
+     * with PQ_ENABLE_STATS defined, and are zero otherwise.
+     */
+    PQStats stats() const;
+
+    /**
+     * Sets all of the counts returned by stats() back to zero.
+     */
+    void resetStats();
+
+    /**
+     * Confirms the kept elements form a valid heap and calls error()
+     * if problems are found.
+     */
+    void validateInternalState();
+
+private:
+    struct Entry {
+        DataPoint point;
+        long long seq;      // position of the element in the offer order
+    };
+
+    Entry* _entries;        // min-heap, weakest kept element at index 0
+    int _k;                 // most elements to keep
+    int _numAllocated;      // number of slots allocated in array
+    int _numFilled;         // number of slots filled in array
+    long long _numOffered;  // number of offers so far
+    mutable PQStats _stats; // work done, for stats(); wouldAccept counts too
+
+    static bool ranksBelow(const Entry& a, const Entry& b);
+    void add(Entry&& entry);
+    void bubbleUp(int index);
+    void bubbleDown(int index);
+    void ensureCapacity(int numNeeded);
+
+    /* Weird C++isms: You're not allowed to copy or assign accumulators. */
+    TopKAccumulator(const TopKAccumulator &) = delete;
+    void operator=(const TopKAccumulator &) = delete;
+
+    /* This macro is needed for memory diagnostics */
+    TRACK_ALLOCATIONS_OF(TopKAccumulator);
+};